@@ -0,0 +1,33 @@
+#ifndef ECS_BENCH_H
+    #define ECS_BENCH_H
+    #include <stddef.h>
+    #include <stdint.h>
+    #include <stdio.h>
+    #include <time.h>
+    #ifdef __GLIBC__
+    #include <malloc.h>
+    #endif
+
+static inline double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+// Bytes currently allocated on the heap, or 0 when the libc can't tell.
+static inline size_t bench_heap_bytes(void) {
+    #ifdef __GLIBC__
+    return mallinfo2().uordblks;
+    #else
+    return 0;
+    #endif
+}
+
+static inline uint64_t bench_rand(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+#endif
@@ -0,0 +1,116 @@
+#include "bench.h"
+#include "ecs_archetype.h"
+#include "ecs_smallmap.h"
+#include "ecs_sparseset.h"
+#include "ecs_types.h"
+#include <ecs_world.h>
+#include <stdlib.h>
+
+#define COMPONENTS 64
+#define ENTITIES 4000
+#define LOOKUPS 2000000
+
+typedef struct {
+    ecs_archetype_id_t archetype;
+    uint64_t component;
+} edge_t;
+
+static size_t collect_edges(ecs_world_t *world, ecs_vec_t *edges) {
+    size_t bytes = 0;
+
+    for (uint32_t i = 0; i < world->archetypes.count; i++) {
+        ecs_archetype_t *archetype = ecs_world_get_archetype(world, i);
+        bytes += ecs_smallmap_memory(&archetype->add_edge);
+        bytes += ecs_smallmap_memory(&archetype->remove_edge);
+        for (uint32_t e = 0; e < archetype->add_edge.count; e++) {
+            ecs_vec_push(edges, &(edge_t) { i, archetype->add_edge.keys[e] });
+        }
+    }
+    return bytes;
+}
+
+static double bench_smallmap(ecs_world_t *world, edge_t *edges, size_t count) {
+    uint64_t state = 42;
+    uint64_t sink = 0;
+    double start = bench_now_ns();
+
+    for (int i = 0; i < LOOKUPS; i++) {
+        edge_t *edge = &edges[bench_rand(&state) % count];
+        sink += *ecs_smallmap_get(&ecs_world_get_archetype(world, edge->archetype)->add_edge, edge->component);
+    }
+    double elapsed = bench_now_ns() - start;
+    if (sink == 1) puts("");
+    return elapsed / LOOKUPS;
+}
+
+static double bench_sparseset(ecs_world_t *world, edge_t *edges, size_t count, size_t *bytes) {
+    uint32_t archetype_count = world->archetypes.count;
+    size_t before = bench_heap_bytes();
+    ecs_sparseset_t *sets = malloc(archetype_count * sizeof(ecs_sparseset_t));
+
+    for (uint32_t i = 0; i < archetype_count; i++) {
+        ecs_sparseset_init(&sets[i], sizeof(ecs_archetype_id_t));
+    }
+    for (size_t i = 0; i < count; i++) {
+        ecs_archetype_id_t target = *ecs_smallmap_get(
+            &ecs_world_get_archetype(world, edges[i].archetype)->add_edge, edges[i].component);
+        ecs_sparseset_insert(&sets[edges[i].archetype], edges[i].component, &target);
+    }
+    *bytes = bench_heap_bytes() - before;
+
+    uint64_t state = 42;
+    uint64_t sink = 0;
+    double start = bench_now_ns();
+
+    for (int i = 0; i < LOOKUPS; i++) {
+        edge_t *edge = &edges[bench_rand(&state) % count];
+        sink += *(ecs_archetype_id_t *) ecs_sparseset_get(&sets[edge->archetype], edge->component);
+    }
+    double elapsed = bench_now_ns() - start;
+    if (sink == 1) puts("");
+
+    for (uint32_t i = 0; i < archetype_count; i++) {
+        ecs_sparseset_fini(&sets[i]);
+    }
+    free(sets);
+    return elapsed / LOOKUPS;
+}
+
+int main(void) {
+    ecs_world_t *world = ecs_init();
+    ecs_entity_t components[COMPONENTS];
+    uint64_t state = 7;
+
+    for (int i = 0; i < COMPONENTS; i++) {
+        components[i] = ecs_new(world);
+        ecs_set_component_meta(world, components[i], sizeof(uint64_t));
+    }
+    for (int i = 0; i < ENTITIES; i++) {
+        ecs_entity_t entity = ecs_new(world);
+        int adds = 1 + bench_rand(&state) % 8;
+        for (int a = 0; a < adds; a++) {
+            ecs_add(world, entity, components[bench_rand(&state) % COMPONENTS]);
+        }
+        if (bench_rand(&state) % 2) {
+            ecs_remove(world, entity, components[bench_rand(&state) % COMPONENTS]);
+        }
+    }
+
+    ecs_vec_t edges = ecs_vec_create(sizeof(edge_t));
+    size_t small_bytes = collect_edges(world, &edges);
+    uint32_t archetypes = world->archetypes.count;
+    size_t sparse_bytes = 0;
+
+    double small_ns = bench_smallmap(world, edges.data, edges.count);
+    double sparse_ns = bench_sparseset(world, edges.data, edges.count, &sparse_bytes);
+
+    printf("bench_edges: %u archetypes, %zu add edges\n", archetypes, edges.count);
+    printf("  ecs_smallmap_t  : %8.1f bytes/archetype (add + remove), %6.2f ns/lookup\n",
+        (double) small_bytes / archetypes, small_ns);
+    printf("  ecs_sparseset_t : %8.1f bytes/archetype (add only)%s, %6.2f ns/lookup\n",
+        (double) sparse_bytes / archetypes, sparse_bytes ? "" : " [heap stats unavailable]", sparse_ns);
+
+    ecs_vec_free(&edges);
+    ecs_fini(world);
+    return 0;
+}
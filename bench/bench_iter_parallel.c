@@ -0,0 +1,72 @@
+#include "bench.h"
+#include "ecs_query.h"
+#include "ecs_system.h"
+#include "ecs_types.h"
+#include <ecs_world.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define ENTITIES 2000000
+#define FRAMES 20
+
+typedef struct {
+    float x, y;
+} BenchPosition, BenchVelocity;
+
+ECS_COMPONENT_DEFINE(BenchPosition);
+ECS_COMPONENT_DEFINE(BenchVelocity);
+
+static void integrate(ecs_iter_t *it) {
+    BenchPosition *p = ecs_field(it, BenchPosition);
+    BenchVelocity *v = ecs_field(it, BenchVelocity);
+
+    for (int i = 0; i < it->count; i++) {
+        p[i].x += v[i].x;
+        p[i].y += v[i].y;
+    }
+}
+
+static double run_frames(ecs_world_t *world, EcsQueryId query, bool parallel) {
+    double start = bench_now_ns();
+
+    for (int frame = 0; frame < FRAMES; frame++) {
+        if (parallel) {
+            ecs_iter_parallel(world, query, integrate, 0);
+        } else {
+            ecs_iter_t it = ecs_query_iter(world, query);
+            while (ecs_iter_next(&it)) {
+                integrate(&it);
+            }
+        }
+    }
+    return (bench_now_ns() - start) / 1e6 / FRAMES;
+}
+
+int main(void) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, BenchPosition);
+    ECS_REGISTER_COMPONENT(world, BenchVelocity);
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    ecs_type_t type = ECS_VEC_RAW(ecs_entity_t, ecs_id(BenchPosition), ecs_id(BenchVelocity));
+    ecs_bulk_new(world, &type, ENTITIES, NULL, NULL);
+
+    ecs_query_t query = query({
+        .terms = {
+            { .id = ecs_id(BenchPosition), .oper = EcsQueryOperEqual },
+            { .id = ecs_id(BenchVelocity), .oper = EcsQueryOperEqual }
+        },
+    });
+    EcsQueryId query_id = ecs_query_register(world, &query);
+
+    double serial_ms = run_frames(world, query_id, false);
+    ecs_set_threads(world, cores > 1 ? cores - 1 : 0);
+    double parallel_ms = run_frames(world, query_id, true);
+
+    printf("bench_iter_parallel: %d entities, %ld threads\n", ENTITIES, cores);
+    printf("  ecs_iter_next      : %8.2f ms/frame\n", serial_ms);
+    printf("  ecs_iter_parallel  : %8.2f ms/frame\n", parallel_ms);
+
+    ecs_fini(world);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "bench.h"
+#include "ecs_archetype.h"
+#include "ecs_query.h"
+#include "ecs_types.h"
+#include <ecs_world.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#define COMPONENTS 256
+#define QUERIES 1000
+#define ARCHETYPES 10000
+
+// The nested loops ecs_query_match_type used before signatures.
+static bool match_naive(const ecs_query_t *query, const ecs_type_t *type) {
+    const uint64_t *ids = type->data;
+
+    for (uint32_t i = 0; query->terms[i].id.value; i++) {
+        bool matched = false;
+        for (uint32_t j = 0; j < type->count; j++) {
+            if (query->terms[i].id.value == ids[j]) {
+                matched = true;
+                break;
+            }
+        }
+        if (matched != (query->terms[i].oper == EcsQueryOperEqual)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    ecs_world_t *world = ecs_init();
+    ecs_entity_t components[COMPONENTS];
+    ecs_query_t *queries = calloc(QUERIES, sizeof(ecs_query_t));
+    uint64_t state = 7;
+
+    for (int i = 0; i < COMPONENTS; i++) {
+        components[i] = ecs_new(world);
+    }
+    for (int q = 0; q < QUERIES; q++) {
+        int terms = 1 + bench_rand(&state) % 4;
+        for (int t = 0; t < terms; t++) {
+            queries[q].terms[t].id = components[bench_rand(&state) % 32];
+            queries[q].terms[t].oper = t == 3 ? EcsQueryOperNot : EcsQueryOperEqual;
+        }
+        ecs_query_register(world, &queries[q]);
+    }
+
+    double start = bench_now_ns();
+    while (world->archetypes.count < ARCHETYPES) {
+        ecs_entity_t entity = ecs_new(world);
+        int adds = 4 + bench_rand(&state) % 20;
+        for (int a = 0; a < adds; a++) {
+            ecs_add(world, entity, components[bench_rand(&state) % COMPONENTS]);
+        }
+    }
+    double create_ms = (bench_now_ns() - start) / 1e6;
+    uint32_t archetypes = world->archetypes.count;
+
+    uint64_t matched = 0;
+    start = bench_now_ns();
+    for (int q = 0; q < QUERIES; q++) {
+        ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, q + world->queries.count - QUERIES);
+        for (uint32_t a = 0; a < archetypes; a++) {
+            matched += ecs_query_signature_match(&cache->signature, ecs_world_get_archetype(world, a)->type);
+        }
+    }
+    double signature_ns = (bench_now_ns() - start) / ((double) QUERIES * archetypes);
+
+    uint64_t naive_matched = 0;
+    start = bench_now_ns();
+    for (int q = 0; q < QUERIES; q++) {
+        for (uint32_t a = 0; a < archetypes; a++) {
+            naive_matched += match_naive(&queries[q], &ecs_world_get_archetype(world, a)->type->ids);
+        }
+    }
+    double naive_ns = (bench_now_ns() - start) / ((double) QUERIES * archetypes);
+
+    printf("bench_query_match: %d queries, %u archetypes, %" PRIu64 " matches%s\n",
+        QUERIES, archetypes, matched, matched == naive_matched ? "" : " [MISMATCH]");
+    printf("  archetype creation : %8.1f ms (all queries matched per new archetype)\n", create_ms);
+    printf("  signature match    : %8.2f ns/pair\n", signature_ns);
+    printf("  nested loops       : %8.2f ns/pair\n", naive_ns);
+
+    free(queries);
+    ecs_fini(world);
+    return 0;
+}
@@ -59,6 +59,8 @@ typedef struct {
     ecs_dsl_term_modifier_t modifier;  // NOT or OPTIONAL
     ecs_dsl_term_operator_t op;        // AND or OR
     ecs_dsl_access_mode_t access;
+    bool changed;                      // Changed(Component)
+    bool cascade;                      // cascade(Relation)
 } ecs_dsl_term_t;
 
 typedef struct {
@@ -125,10 +125,36 @@ static bool parse_pair(ecs_dsl_parser_t *parser, ecs_dsl_identifier_t *id) {
     return true;
 }
 
+// Keyword(Identifier) sets `flag`; a bare keyword is a plain identifier.
+static bool parse_wrapped(ecs_dsl_parser_t *parser, ecs_dsl_term_t *term, const char *keyword, bool *flag) {
+    parser_advance(parser);
+
+    if (parser->current_token.type != ECS_DSL_TOKEN_LPAREN) {
+        identifier_init(&term->id);
+        term->id.first = strdup(keyword);
+        return true;
+    }
+    parser_advance(parser);
+
+    if (!parse_identifier(parser, &term->id)) {
+        return false;
+    }
+    if (parser->current_token.type != ECS_DSL_TOKEN_RPAREN) {
+        identifier_free(&term->id);
+        return false;
+    }
+    parser_advance(parser);
+
+    *flag = true;
+    return true;
+}
+
 static bool parse_term(ecs_dsl_parser_t *parser, ecs_dsl_term_t *term) {
     term->op = ECS_DSL_OP_AND;
     term->modifier = ECS_DSL_MOD_NONE;
     term->access = ECS_DSL_ACCESS_DEFAULT;
+    term->changed = false;
+    term->cascade = false;
 
     if (parser->current_token.type == ECS_DSL_TOKEN_IN) {
         term->access = ECS_DSL_ACCESS_IN;
@@ -149,6 +175,15 @@ static bool parse_term(ecs_dsl_parser_t *parser, ecs_dsl_term_t *term) {
         parser_advance(parser);
     }
 
+    if (parser->current_token.type == ECS_DSL_TOKEN_IDENTIFIER
+        && strcmp(parser->current_token.value, "Changed") == 0) {
+        return parse_wrapped(parser, term, "Changed", &term->changed);
+    }
+    if (parser->current_token.type == ECS_DSL_TOKEN_IDENTIFIER
+        && strcmp(parser->current_token.value, "cascade") == 0) {
+        return parse_wrapped(parser, term, "cascade", &term->cascade);
+    }
+
     if (parser->current_token.type == ECS_DSL_TOKEN_LPAREN) {
         if (!parse_pair(parser, &term->id)) {
             return false;
@@ -21,11 +21,7 @@ void stdio_devtool_execute_query(ecs_world_t *world, const char *query_str)
     while (ecs_iter_next(&iter)) {
         for (int i = 0; i < iter.count; i++) {
             found = true;
-            ecs_entity_t entity = *ECS_VEC_GET(
-                ecs_entity_t,
-                &iter.archetype_p->entities,
-                i
-            );
+            ecs_entity_t entity = ecs_it_entity(&iter, i);
             ecs_print_entity(world, entity);
         }
     }
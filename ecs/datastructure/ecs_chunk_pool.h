@@ -0,0 +1,50 @@
+#ifndef ECS_CHUNK_POOL_H
+    #define ECS_CHUNK_POOL_H
+    #include "ecs_config.h"
+    #include "ecs_vec.h"
+    #include <stdint.h>
+    #include <stdlib.h>
+
+    #define ECS_CHUNK_SIZE (16 * 1024)
+    #define ECS_CHUNK_ALIGN 16
+
+// Recycles fixed-size table chunks so that growing an archetype never
+// reallocs (and never moves) the rows it already holds.
+typedef struct {
+    ecs_vec_t free_chunks; // void *
+    uint32_t allocated;
+} ecs_chunk_pool_t;
+
+ECS_INLINE
+void ecs_chunk_pool_init(ecs_chunk_pool_t *pool) {
+    ecs_vec_init(&pool->free_chunks, sizeof(void *));
+    pool->allocated = 0;
+}
+
+ECS_INLINE
+void *ecs_chunk_pool_alloc(ecs_chunk_pool_t *pool) {
+    if (pool->free_chunks.count > 0) {
+        void *chunk = *ECS_VEC_GET_LAST(void *, &pool->free_chunks);
+        ecs_vec_remove_last(&pool->free_chunks);
+        return chunk;
+    }
+    pool->allocated++;
+    return aligned_alloc(ECS_CHUNK_ALIGN, ECS_CHUNK_SIZE);
+}
+
+ECS_INLINE
+void ecs_chunk_pool_free(ecs_chunk_pool_t *pool, void *chunk) {
+    ecs_vec_push(&pool->free_chunks, &chunk);
+}
+
+ECS_INLINE
+void ecs_chunk_pool_fini(ecs_chunk_pool_t *pool) {
+    void **chunks = pool->free_chunks.data;
+    for (size_t i = 0; i < pool->free_chunks.count; i++) {
+        free(chunks[i]);
+    }
+    ecs_vec_free(&pool->free_chunks);
+    pool->allocated = 0;
+}
+
+#endif
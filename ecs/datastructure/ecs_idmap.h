@@ -0,0 +1,131 @@
+#ifndef ECS_IDMAP_H
+    #define ECS_IDMAP_H
+    #include "ecs_config.h"
+    #include <stdbool.h>
+    #include <stdint.h>
+    #include <stdlib.h>
+    #include <string.h>
+
+    #define ECS_IDMAP_EMPTY 0
+    #define ECS_IDMAP_MIN_CAPACITY 16
+
+// Open-addressed (linear probing) map from a non-zero 64-bit id to a 32-bit
+// value. Key 0 marks an empty slot.
+typedef struct {
+    uint64_t key;
+    uint32_t value;
+} ecs_idmap_entry_t;
+
+typedef struct {
+    ecs_idmap_entry_t *entries;
+    uint32_t capacity;
+    uint32_t count;
+} ecs_idmap_t;
+
+ECS_INLINE
+uint64_t ecs_idmap_hash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+ECS_INLINE
+void ecs_idmap_init(ecs_idmap_t *map) {
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+ECS_INLINE
+void ecs_idmap_fini(ecs_idmap_t *map) {
+    free(map->entries);
+    ecs_idmap_init(map);
+}
+
+ECS_INLINE
+uint32_t *ecs_idmap_get(const ecs_idmap_t *map, uint64_t key) {
+    if (map->capacity == 0) {
+        return NULL;
+    }
+
+    uint32_t mask = map->capacity - 1;
+    for (uint32_t i = ecs_idmap_hash(key) & mask;; i = (i + 1) & mask) {
+        ecs_idmap_entry_t *entry = &map->entries[i];
+        if (entry->key == key) {
+            return &entry->value;
+        }
+        if (entry->key == ECS_IDMAP_EMPTY) {
+            return NULL;
+        }
+    }
+}
+
+ECS_INLINE
+void ecs_idmap_put_unchecked(ecs_idmap_t *map, uint64_t key, uint32_t value) {
+    uint32_t mask = map->capacity - 1;
+    uint32_t i = ecs_idmap_hash(key) & mask;
+
+    while (map->entries[i].key != ECS_IDMAP_EMPTY && map->entries[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    if (map->entries[i].key == ECS_IDMAP_EMPTY) {
+        map->count++;
+    }
+    map->entries[i].key = key;
+    map->entries[i].value = value;
+}
+
+ECS_INLINE
+void ecs_idmap_grow(ecs_idmap_t *map) {
+    ecs_idmap_entry_t *old = map->entries;
+    uint32_t old_capacity = map->capacity;
+
+    map->capacity = old_capacity ? old_capacity * 2 : ECS_IDMAP_MIN_CAPACITY;
+    map->entries = calloc(map->capacity, sizeof(ecs_idmap_entry_t));
+    map->count = 0;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old[i].key != ECS_IDMAP_EMPTY) {
+            ecs_idmap_put_unchecked(map, old[i].key, old[i].value);
+        }
+    }
+    free(old);
+}
+
+ECS_INLINE
+void ecs_idmap_set(ecs_idmap_t *map, uint64_t key, uint32_t value) {
+    if (ECS_UNLIKELY((map->count + 1) * 4 > map->capacity * 3)) {
+        ecs_idmap_grow(map);
+    }
+    ecs_idmap_put_unchecked(map, key, value);
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones.
+ECS_INLINE
+bool ecs_idmap_remove(ecs_idmap_t *map, uint64_t key) {
+    if (map->capacity == 0) {
+        return false;
+    }
+
+    uint32_t mask = map->capacity - 1;
+    uint32_t i = ecs_idmap_hash(key) & mask;
+
+    while (map->entries[i].key != key) {
+        if (map->entries[i].key == ECS_IDMAP_EMPTY) {
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+    for (uint32_t j = (i + 1) & mask; map->entries[j].key != ECS_IDMAP_EMPTY; j = (j + 1) & mask) {
+        uint32_t home = ecs_idmap_hash(map->entries[j].key) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            map->entries[i] = map->entries[j];
+            i = j;
+        }
+    }
+    map->entries[i].key = ECS_IDMAP_EMPTY;
+    map->count--;
+    return true;
+}
+
+#endif
@@ -2,23 +2,30 @@
 #define ECS_VEC_HASHMAP_H
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ecs_config.h>
 #include "ecs_vec.h"
 
-#define HASHMAP_CAPACITY 8192
-#define EMPTY_KEY 0xFFFFFFFFFFFFFFFFULL
+#define HASHMAP_MIN_CAPACITY 64
 
+// Robin Hood map from a precomputed type hash to an interned type id. Keys
+// are not stored: callers pass an equality callback that compares their
+// probe against the type behind a candidate value.
 typedef struct {
-    ecs_vec_t key;
-    uint64_t value;
-    bool used;
+    uint64_t hash;
+    uint32_t value;
+    uint32_t distance; // probe distance + 1, 0 when the slot is empty
 } hash_entry_t;
 
 typedef struct {
-    hash_entry_t entries[HASHMAP_CAPACITY];
+    hash_entry_t *entries;
+    uint32_t capacity;
+    uint32_t count;
 } ecs_hashmap_t;
 
+typedef bool (*ecs_hashmap_eq_t)(const void *ctx, uint32_t value);
+
 ECS_INLINE
 uint64_t hash64(uint64_t x) {
     x ^= x >> 33;
@@ -29,6 +36,7 @@ uint64_t hash64(uint64_t x) {
     return x;
 }
 
+// Order independent, so adding or removing one id is a single xor.
 ECS_INLINE
 uint64_t hash_key(const ecs_vec_t *k) {
     uint64_t h = 0xCBF29CE484222325ULL;
@@ -39,6 +47,11 @@ uint64_t hash_key(const ecs_vec_t *k) {
     return h;
 }
 
+ECS_INLINE
+uint64_t hash_key_toggle(uint64_t h, uint64_t id) {
+    return h ^ hash64(id);
+}
+
 ECS_INLINE
 bool key_equal(const ecs_vec_t *a, const ecs_vec_t *b) {
     if (a->count != b->count) return false;
@@ -47,73 +60,124 @@ bool key_equal(const ecs_vec_t *a, const ecs_vec_t *b) {
 
 ECS_INLINE
 void ecs_hashmap_init(ecs_hashmap_t *map) {
-    for (int i = 0; i < HASHMAP_CAPACITY; i++) {
-        map->entries[i].used = false;
-        ecs_vec_init(&map->entries[i].key, sizeof(uint64_t));
-    }
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
 }
 
 ECS_INLINE
 void ecs_hashmap_fini(ecs_hashmap_t *map) {
-    for (int i = 0; i < HASHMAP_CAPACITY; i++) {
-        ecs_vec_free(&map->entries[i].key);
-    }
+    free(map->entries);
+    ecs_hashmap_init(map);
 }
 
 ECS_INLINE
-bool ecs_hashmap_put(ecs_hashmap_t *map, const ecs_vec_t *key, uint64_t value) {
-    uint64_t h = hash_key(key);
-    uint64_t idx = h & (HASHMAP_CAPACITY - 1);
-
-    for (int i = 0; i < HASHMAP_CAPACITY; i++) {
-        uint64_t probe = (idx + i) & (HASHMAP_CAPACITY - 1);
-        hash_entry_t *e = &map->entries[probe];
-
-        if (!e->used || key_equal(&e->key, key)) {
-            ecs_vec_free(&e->key);
-            ecs_vec_copy((ecs_vec_t *)key, &e->key);
-            e->value = value;
-            e->used = true;
+bool ecs_hashmap_get(
+    const ecs_hashmap_t *map,
+    uint64_t hash,
+    ecs_hashmap_eq_t eq,
+    const void *ctx,
+    uint32_t *out_value
+) {
+    if (map->capacity == 0) {
+        return false;
+    }
+
+    uint32_t mask = map->capacity - 1;
+    uint32_t idx = hash & mask;
+
+    for (uint32_t distance = 1;; distance++) {
+        const hash_entry_t *e = &map->entries[idx];
+
+        if (e->distance < distance) return false;
+        if (e->hash == hash && eq(ctx, e->value)) {
+            *out_value = e->value;
             return true;
         }
+        idx = (idx + 1) & mask;
     }
-    return false;
 }
 
 ECS_INLINE
-bool ecs_hashmap_get(const ecs_hashmap_t *map, const ecs_vec_t *key, uint64_t *out_value) {
-    uint64_t h = hash_key(key);
-    uint64_t idx = h & (HASHMAP_CAPACITY - 1);
-
-    for (int i = 0; i < HASHMAP_CAPACITY; i++) {
-        uint64_t probe = (idx + i) & (HASHMAP_CAPACITY - 1);
-        const hash_entry_t *e = &map->entries[probe];
+void ecs_hashmap_insert_entry(ecs_hashmap_t *map, hash_entry_t entry) {
+    uint32_t mask = map->capacity - 1;
+    uint32_t idx = entry.hash & mask;
+
+    entry.distance = 1;
+    for (;;) {
+        hash_entry_t *e = &map->entries[idx];
+
+        if (e->distance == 0) {
+            *e = entry;
+            map->count++;
+            return;
+        }
+        if (e->distance < entry.distance) {
+            hash_entry_t swapped = *e;
+            *e = entry;
+            entry = swapped;
+        }
+        entry.distance++;
+        idx = (idx + 1) & mask;
+    }
+}
 
-        if (!e->used) return false;
-        if (key_equal(&e->key, key)) {
-            *out_value = e->value;
-            return true;
+ECS_INLINE
+void ecs_hashmap_grow(ecs_hashmap_t *map) {
+    hash_entry_t *old = map->entries;
+    uint32_t old_capacity = map->capacity;
+
+    map->capacity = old_capacity ? old_capacity * 2 : HASHMAP_MIN_CAPACITY;
+    map->entries = calloc(map->capacity, sizeof(hash_entry_t));
+    map->count = 0;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        if (old[i].distance) {
+            ecs_hashmap_insert_entry(map, old[i]);
         }
     }
-    return false;
+    free(old);
 }
 
+// The caller guarantees the key is not already present.
 ECS_INLINE
-bool ecs_hashmap_remove(ecs_hashmap_t *map, const ecs_vec_t *key) {
-    uint64_t h = hash_key(key);
-    uint64_t idx = h & (HASHMAP_CAPACITY - 1);
-
-    for (int i = 0; i < HASHMAP_CAPACITY; i++) {
-        uint64_t probe = (idx + i) & (HASHMAP_CAPACITY - 1);
-        hash_entry_t *e = &map->entries[probe];
-        if (!e->used) return false;
-        if (key_equal(&e->key, key)) {
-            ecs_vec_free(&e->key);
-            e->used = false;
-            return true;
+void ecs_hashmap_put(ecs_hashmap_t *map, uint64_t hash, uint32_t value) {
+    if (ECS_UNLIKELY((map->count + 1) * 8 > map->capacity * 7)) {
+        ecs_hashmap_grow(map);
+    }
+    ecs_hashmap_insert_entry(map, (hash_entry_t) { .hash = hash, .value = value });
+}
+
+ECS_INLINE
+bool ecs_hashmap_remove(ecs_hashmap_t *map, uint64_t hash, ecs_hashmap_eq_t eq, const void *ctx) {
+    if (map->capacity == 0) {
+        return false;
+    }
+
+    uint32_t mask = map->capacity - 1;
+    uint32_t idx = hash & mask;
+
+    for (uint32_t distance = 1;; distance++) {
+        hash_entry_t *e = &map->entries[idx];
+
+        if (e->distance < distance) return false;
+        if (e->hash == hash && eq(ctx, e->value)) break;
+        idx = (idx + 1) & mask;
+    }
+
+    for (;;) {
+        uint32_t next = (idx + 1) & mask;
+        hash_entry_t *n = &map->entries[next];
+
+        if (n->distance <= 1) {
+            map->entries[idx].distance = 0;
+            break;
         }
+        map->entries[idx] = *n;
+        map->entries[idx].distance--;
+        idx = next;
     }
-    return false;
+    map->count--;
+    return true;
 }
 
 #endif
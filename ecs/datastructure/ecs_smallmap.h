@@ -0,0 +1,99 @@
+#ifndef ECS_SMALLMAP_H
+    #define ECS_SMALLMAP_H
+    #include "ecs_config.h"
+    #include "ecs_idmap.h"
+    #include <stdbool.h>
+    #include <stdint.h>
+
+    #define ECS_SMALLMAP_INLINE 4
+
+// Id -> 32-bit value map for the handful of entries most archetypes need:
+// the first ECS_SMALLMAP_INLINE entries live inline, the rest spill into an
+// ecs_idmap_t that is only allocated on demand.
+typedef struct {
+    uint64_t keys[ECS_SMALLMAP_INLINE];
+    uint32_t values[ECS_SMALLMAP_INLINE];
+    uint32_t count;
+    ecs_idmap_t spill;
+} ecs_smallmap_t;
+
+ECS_INLINE
+void ecs_smallmap_init(ecs_smallmap_t *map) {
+    map->count = 0;
+    ecs_idmap_init(&map->spill);
+}
+
+ECS_INLINE
+void ecs_smallmap_fini(ecs_smallmap_t *map) {
+    ecs_idmap_fini(&map->spill);
+    map->count = 0;
+}
+
+ECS_INLINE
+uint32_t *ecs_smallmap_get(ecs_smallmap_t *map, uint64_t key) {
+    for (uint32_t i = 0; i < map->count; i++) {
+        if (map->keys[i] == key) {
+            return &map->values[i];
+        }
+    }
+    return ecs_idmap_get(&map->spill, key);
+}
+
+ECS_INLINE
+void ecs_smallmap_set(ecs_smallmap_t *map, uint64_t key, uint32_t value) {
+    uint32_t *existing = ecs_smallmap_get(map, key);
+
+    if (existing) {
+        *existing = value;
+    } else if (map->count < ECS_SMALLMAP_INLINE) {
+        map->keys[map->count] = key;
+        map->values[map->count] = value;
+        map->count++;
+    } else {
+        ecs_idmap_set(&map->spill, key, value);
+    }
+}
+
+ECS_INLINE
+bool ecs_smallmap_remove(ecs_smallmap_t *map, uint64_t key) {
+    for (uint32_t i = 0; i < map->count; i++) {
+        if (map->keys[i] == key) {
+            map->count--;
+            map->keys[i] = map->keys[map->count];
+            map->values[i] = map->values[map->count];
+            return true;
+        }
+    }
+    return ecs_idmap_remove(&map->spill, key);
+}
+
+// Entries are visited by slot, from 0 to ecs_smallmap_slot_count(); empty
+// spill slots report false.
+ECS_INLINE
+uint32_t ecs_smallmap_slot_count(const ecs_smallmap_t *map) {
+    return ECS_SMALLMAP_INLINE + map->spill.capacity;
+}
+
+ECS_INLINE
+bool ecs_smallmap_slot(const ecs_smallmap_t *map, uint32_t slot, uint64_t *key, uint32_t *value) {
+    if (slot < ECS_SMALLMAP_INLINE) {
+        if (slot >= map->count) {
+            return false;
+        }
+        *key = map->keys[slot];
+        *value = map->values[slot];
+        return true;
+    }
+
+    const ecs_idmap_entry_t *entry = &map->spill.entries[slot - ECS_SMALLMAP_INLINE];
+    *key = entry->key;
+    *value = entry->value;
+    return entry->key != ECS_IDMAP_EMPTY;
+}
+
+ECS_INLINE
+size_t ecs_smallmap_memory(const ecs_smallmap_t *map) {
+    return sizeof(*map) + map->spill.capacity * sizeof(ecs_idmap_entry_t);
+}
+
+#endif
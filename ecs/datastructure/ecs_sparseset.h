@@ -1,141 +1,165 @@
 #ifndef ECS_SPARSESET_H
     #define ECS_SPARSESET_H
+    #include "ecs_idmap.h"
     #include "ecs_vec.h"
     #include <stdbool.h>
     #include <stdint.h>
     #include <stdio.h>
     #include <string.h>
 
-typedef struct {
-    uint32_t indices[256];
-} ecs_sparseset_page_t;
+    #define ECS_SPARSESET_PAGE_BITS 8
+    #define ECS_SPARSESET_PAGE_SIZE (1 << ECS_SPARSESET_PAGE_BITS)
+    #define ECS_SPARSESET_PAGE_MASK (ECS_SPARSESET_PAGE_SIZE - 1)
+    #define ECS_SPARSESET_EMPTY UINT32_MAX
 
 typedef struct {
-    void *pages[1024];
-} ecs_sparseset_lvl_t;
+    uint32_t indices[ECS_SPARSESET_PAGE_SIZE];
+} ecs_sparseset_page_t;
 
+// Keys that fit in 32 bits (plain entity indices) go through a two-level
+// page table; anything with high bits set (pairs, recycled generations)
+// falls back to an open-addressed hash. Lookups never allocate.
 typedef struct {
     ecs_vec_t dense;
-    ecs_vec_t dense_sparse_key;
-    ecs_sparseset_lvl_t root;
+    ecs_vec_t dense_sparse_key; // uint64_t
+    ecs_vec_t pages; // ecs_sparseset_page_t *
+    ecs_idmap_t high_keys;
 } ecs_sparseset_t;
 
-
 ECS_INLINE
-ecs_sparseset_lvl_t *ensure_alloc(void **ptr) {
-    if (__builtin_expect(*ptr == NULL, 0)) {
-        *ptr = calloc(1, sizeof(ecs_sparseset_lvl_t));
+uint32_t *ecs_sparseset_find_slot(const ecs_sparseset_t *set, uint64_t key) {
+    if (ECS_UNLIKELY(key >> 32)) {
+        return ecs_idmap_get(&set->high_keys, key);
+    }
+
+    uint64_t page_index = key >> ECS_SPARSESET_PAGE_BITS;
+    if (page_index >= set->pages.count) {
+        return NULL;
+    }
+
+    ecs_sparseset_page_t *page = ((ecs_sparseset_page_t **) set->pages.data)[page_index];
+    if (page == NULL) {
+        return NULL;
     }
-    return *ptr;
+
+    uint32_t *slot = &page->indices[key & ECS_SPARSESET_PAGE_MASK];
+    return *slot == ECS_SPARSESET_EMPTY ? NULL : slot;
 }
 
 ECS_INLINE
-ecs_sparseset_page_t *get_sparse_page(ecs_sparseset_t *set, uint64_t key) {
-    ecs_sparseset_lvl_t *lvl1 = ensure_alloc((void**)&set->root.pages[(key >> 38) & 0x3FF]);
-    ecs_sparseset_lvl_t *lvl2 = ensure_alloc((void**)&lvl1->pages[(key >> 28) & 0x3FF]);
-    ecs_sparseset_lvl_t *lvl3 = ensure_alloc((void**)&lvl2->pages[(key >> 18) & 0x3FF]);
+uint32_t *ecs_sparseset_ensure_slot(ecs_sparseset_t *set, uint64_t key) {
+    uint64_t page_index = key >> ECS_SPARSESET_PAGE_BITS;
 
-    ecs_sparseset_page_t **page = (ecs_sparseset_page_t**)&lvl3->pages[(key >> 8) & 0x3FF];
+    if (page_index >= set->pages.count) {
+        ecs_vec_set_new_capacity_with_default(&set->pages, page_index, &(void *) {NULL}, &(void *) {NULL});
+    }
 
+    ecs_sparseset_page_t **page = ECS_VEC_GET(ecs_sparseset_page_t *, &set->pages, page_index);
     if (ECS_UNLIKELY(*page == NULL)) {
         *page = malloc(sizeof(ecs_sparseset_page_t));
         memset(*page, 0xFF, sizeof(ecs_sparseset_page_t));
     }
 
-    return *page;
+    return &(*page)->indices[key & ECS_SPARSESET_PAGE_MASK];
+}
+
+ECS_INLINE
+void ecs_sparseset_set_dense_index(ecs_sparseset_t *set, uint64_t key, uint32_t dense_index) {
+    if (ECS_UNLIKELY(key >> 32)) {
+        ecs_idmap_set(&set->high_keys, key, dense_index);
+        return;
+    }
+    *ecs_sparseset_ensure_slot(set, key) = dense_index;
 }
 
 ECS_INLINE
 void ecs_sparseset_insert(ecs_sparseset_t *set, uint64_t key, void *value) {
-    uint8_t offset = key & 0xFF;
-    ecs_sparseset_page_t *page = get_sparse_page(set, key);
-    uint32_t index = page->indices[offset];
-
-    if (index == UINT32_MAX) {
-        ecs_vec_push(&set->dense, value);
-        ecs_vec_push(&set->dense_sparse_key, &index);
-        page->indices[offset] = set->dense.count - 1;
+    uint32_t *slot = ecs_sparseset_find_slot(set, key);
+
+    if (slot != NULL) {
+        ecs_vec_set_unsafe(&set->dense, *slot, value);
         return;
     }
 
-    ecs_vec_set_unsafe(&set->dense, index, value);
+    ecs_vec_push(&set->dense, value);
+    ecs_vec_push(&set->dense_sparse_key, &key);
+    ecs_sparseset_set_dense_index(set, key, set->dense.count - 1);
 }
 
+// Value of `key`, inserted zeroed if it was missing.
 ECS_INLINE
-void *ecs_sparseset_get(ecs_sparseset_t *set, uint64_t key) {
-    uint32_t index = get_sparse_page(set, key)->indices[key & 0xFF];
+void *ecs_sparseset_ensure(ecs_sparseset_t *set, uint64_t key) {
+    uint32_t *slot = ecs_sparseset_find_slot(set, key);
 
-    if (index == UINT32_MAX) {
-        return NULL;
+    if (slot != NULL) {
+        return ECS_VEC_GET(void, &set->dense, *slot);
     }
-
-    return ECS_VEC_GET(void, &set->dense, index);
+    ecs_vec_push_zero(&set->dense);
+    ecs_vec_push(&set->dense_sparse_key, &key);
+    ecs_sparseset_set_dense_index(set, key, set->dense.count - 1);
+    return ECS_VEC_GET(void, &set->dense, set->dense.count - 1);
 }
 
 ECS_INLINE
-void ecs_sparseset_set_dense_index(ecs_sparseset_t *set, uint64_t key, uint32_t dense_index) {
-    get_sparse_page(set, key)->indices[key & 0xFF] = dense_index;
+void *ecs_sparseset_get(const ecs_sparseset_t *set, uint64_t key) {
+    uint32_t *slot = ecs_sparseset_find_slot(set, key);
+
+    if (slot == NULL) {
+        return NULL;
+    }
+
+    return ECS_VEC_GET(void, &set->dense, *slot);
 }
 
 ECS_INLINE
-bool ecs_sparseset_exists(ecs_sparseset_t *set, uint64_t key) {
-    return get_sparse_page(set, key)->indices[key & 0xFF] != UINT32_MAX;
+bool ecs_sparseset_exists(const ecs_sparseset_t *set, uint64_t key) {
+    return ecs_sparseset_find_slot(set, key) != NULL;
 }
 
 ECS_INLINE
 void ecs_sparseset_remove(ecs_sparseset_t *set, uint64_t key) {
-    uint8_t offset = key & 0xFF;
-    ecs_sparseset_page_t *page = get_sparse_page(set, key);
-    uint32_t index = page->indices[offset];
+    uint32_t *slot = ecs_sparseset_find_slot(set, key);
 
-    ecs_vec_remove_fast(&set->dense, index);
+    if (slot == NULL) {
+        return;
+    }
 
-    uint32_t last_index = set->dense.count;
-    if (index != last_index) {
-        uint32_t *swapped_key = ECS_VEC_GET(uint32_t, &set->dense_sparse_key, index);
-        ecs_sparseset_set_dense_index(set, *swapped_key, index);
+    uint32_t index = *slot;
+    if (key >> 32) {
+        ecs_idmap_remove(&set->high_keys, key);
+    } else {
+        *slot = ECS_SPARSESET_EMPTY;
     }
 
+    ecs_vec_remove_fast(&set->dense, index);
     ecs_vec_remove_fast(&set->dense_sparse_key, index);
-    page->indices[offset] = UINT32_MAX;
+
+    if (index != set->dense.count) {
+        uint64_t swapped_key = *ECS_VEC_GET(uint64_t, &set->dense_sparse_key, index);
+        ecs_sparseset_set_dense_index(set, swapped_key, index);
+    }
 }
 
 ECS_INLINE
 void ecs_sparseset_init(ecs_sparseset_t *set, size_t elem_size) {
-    set->dense = ecs_vec_create(elem_size);
-    set->dense_sparse_key = ecs_vec_create(sizeof(uint_fast64_t));
-    set->root = (ecs_sparseset_lvl_t) {0};
+    // nothing is allocated until the first insert
+    set->dense = (ecs_vec_t) { .size = elem_size };
+    set->dense_sparse_key = (ecs_vec_t) { .size = sizeof(uint64_t) };
+    set->pages = (ecs_vec_t) { .size = sizeof(ecs_sparseset_page_t *) };
+    ecs_idmap_init(&set->high_keys);
 }
 
 ECS_INLINE
 void ecs_sparseset_fini(ecs_sparseset_t *set) {
-    ecs_vec_free(&set->dense);
-    ecs_vec_free(&set->dense_sparse_key);
+    ecs_sparseset_page_t **pages = set->pages.data;
 
-    for (int i = 0; i < 1024; i++) {
-        ecs_sparseset_lvl_t *lvl1 = (ecs_sparseset_lvl_t *)set->root.pages[i];
-        if (lvl1 == NULL) continue;
-
-        for (int j = 0; j < 1024; j++) {
-            ecs_sparseset_lvl_t *lvl2 = (ecs_sparseset_lvl_t *)lvl1->pages[j];
-            if (lvl2 == NULL) continue;
-
-            for (int k = 0; k < 1024; k++) {
-                ecs_sparseset_lvl_t *lvl3 = (ecs_sparseset_lvl_t *)lvl2->pages[k];
-                if (lvl3 == NULL) continue;
-
-                for (int l = 0; l < 1024; l++) {
-                    ecs_sparseset_page_t *page = (ecs_sparseset_page_t *)lvl3->pages[l];
-                    if (page != NULL) {
-                        free(page);
-                    }
-                }
-                free(lvl3);
-            }
-            free(lvl2);
-        }
-        free(lvl1);
+    for (size_t i = 0; i < set->pages.count; i++) {
+        free(pages[i]);
     }
+    ecs_vec_free(&set->pages);
+    ecs_vec_free(&set->dense);
+    ecs_vec_free(&set->dense_sparse_key);
+    ecs_idmap_fini(&set->high_keys);
 }
 
 #endif
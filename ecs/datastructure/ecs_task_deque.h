@@ -0,0 +1,54 @@
+#ifndef ECS_TASK_DEQUE_H
+    #define ECS_TASK_DEQUE_H
+    #include "ecs_config.h"
+    #include <stdatomic.h>
+    #include <stdbool.h>
+    #include <stdint.h>
+
+// A worker's share of a fixed task list: the indices in [head, tail). The
+// owner pops from the tail, thieves take from the head. Both ends live in
+// one word, so every transfer is a single compare-and-swap.
+typedef struct {
+    _Alignas(64) _Atomic uint64_t bounds; // head in the low half, tail in the high half
+} ecs_task_deque_t;
+
+ECS_INLINE
+uint64_t ecs_task_deque_pack(uint32_t head, uint32_t tail) {
+    return (uint64_t) tail << 32 | head;
+}
+
+ECS_INLINE
+void ecs_task_deque_init(ecs_task_deque_t *deque, uint32_t head, uint32_t tail) {
+    atomic_init(&deque->bounds, ecs_task_deque_pack(head, tail));
+}
+
+ECS_INLINE
+bool ecs_task_deque_take(ecs_task_deque_t *deque, bool steal, uint32_t *out_task) {
+    uint64_t bounds = atomic_load_explicit(&deque->bounds, memory_order_relaxed);
+
+    for (;;) {
+        uint32_t head = (uint32_t) bounds;
+        uint32_t tail = (uint32_t) (bounds >> 32);
+
+        if (head >= tail) {
+            return false;
+        }
+        uint64_t next = steal ? ecs_task_deque_pack(head + 1, tail) : ecs_task_deque_pack(head, tail - 1);
+        if (atomic_compare_exchange_weak(&deque->bounds, &bounds, next)) {
+            *out_task = steal ? head : tail - 1;
+            return true;
+        }
+    }
+}
+
+ECS_INLINE
+bool ecs_task_deque_pop(ecs_task_deque_t *deque, uint32_t *out_task) {
+    return ecs_task_deque_take(deque, false, out_task);
+}
+
+ECS_INLINE
+bool ecs_task_deque_steal(ecs_task_deque_t *deque, uint32_t *out_task) {
+    return ecs_task_deque_take(deque, true, out_task);
+}
+
+#endif
@@ -1,4 +1,6 @@
 #include "ecs_archetype.h"
+#include "datastructure/ecs_chunk_pool.h"
+#include "datastructure/ecs_smallmap.h"
 #include "datastructure/ecs_sparseset.h"
 #include "datastructure/ecs_vec.h"
 #include "datastructure/ecs_vec_sort.h"
@@ -6,49 +8,185 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-void ecs_archetype_init(ecs_archetype_t *archetype)
+#define ECS_ALIGN_UP(value, align) (((value) + (align) - 1) & ~((size_t) (align) - 1))
+
+void ecs_archetype_init(ecs_archetype_t *archetype, const ecs_type_info_t *type, ecs_chunk_pool_t *chunk_pool)
 {
-    ecs_sparseset_init(&archetype->rows, sizeof(ecs_vec_t));
-    ecs_sparseset_init(&archetype->add_edge, sizeof(ecs_archetype_id_t));
-    ecs_sparseset_init(&archetype->remove_edge, sizeof(ecs_archetype_id_t));
-    ecs_vec_init(&archetype->type, sizeof(ecs_entity_t));
-    ecs_vec_init(&archetype->entities, sizeof(uint32_t));
+    ecs_sparseset_init(&archetype->rows, sizeof(ecs_column_t));
+    ecs_smallmap_init(&archetype->add_edge);
+    ecs_smallmap_init(&archetype->remove_edge);
+    archetype->type = type;
+    // nothing is allocated until the first row is inserted
+    archetype->entities = (ecs_vec_t) { .size = sizeof(ecs_entity_t) };
+    archetype->chunks = (ecs_vec_t) { .size = sizeof(void *) };
+    archetype->query_refs = (ecs_vec_t) { .size = sizeof(ecs_archetype_query_ref_t) };
+    archetype->observer_refs = (ecs_vec_t) { .size = sizeof(ecs_archetype_observer_ref_t) };
+    archetype->empty_since = 0;
+    archetype->chunk_pool = chunk_pool;
+    archetype->chunk_capacity = UINT32_MAX;
+    archetype->chunk_size = 0;
+}
+
+static void *ecs_archetype_chunk_alloc(ecs_archetype_t *archetype)
+{
+    if (archetype->chunk_size == ECS_CHUNK_SIZE) {
+        return ecs_chunk_pool_alloc(archetype->chunk_pool);
+    }
+    return aligned_alloc(ECS_CHUNK_ALIGN, archetype->chunk_size);
+}
+
+static void ecs_archetype_chunk_free(ecs_archetype_t *archetype, void *chunk)
+{
+    if (archetype->chunk_size == ECS_CHUNK_SIZE) {
+        ecs_chunk_pool_free(archetype->chunk_pool, chunk);
+    } else {
+        free(chunk);
+    }
 }
 
 void ecs_archetype_fini(ecs_archetype_t *archetype)
 {
-    ecs_vec_t *rows = archetype->rows.dense.data;
-    uint32_t count = archetype->rows.dense.count;
-    for (uint32_t i = 0; i < count; i++) {
-        ecs_vec_free(&rows[i]);
+    void **chunks = archetype->chunks.data;
+    for (size_t i = 0; i < archetype->chunks.count; i++) {
+        ecs_archetype_chunk_free(archetype, chunks[i]);
     }
+    ecs_vec_free(&archetype->chunks);
     ecs_sparseset_fini(&archetype->rows);
-    ecs_sparseset_fini(&archetype->add_edge);
-    ecs_sparseset_fini(&archetype->remove_edge);
-    ecs_vec_free(&archetype->type);
+    ecs_smallmap_fini(&archetype->add_edge);
+    ecs_smallmap_fini(&archetype->remove_edge);
     ecs_vec_free(&archetype->entities);
+    ecs_vec_free(&archetype->query_refs);
+    ecs_vec_free(&archetype->observer_refs);
 }
 
+// Columns are packed one after the other inside a chunk, each one padded to
+// ECS_CHUNK_ALIGN. Rows wider than a chunk get a dedicated one-row chunk.
+static void ecs_archetype_layout(ecs_archetype_t *archetype)
+{
+    ecs_column_t *columns = archetype->rows.dense.data;
+    size_t count = archetype->rows.dense.count;
+    size_t row_size = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        row_size += columns[i].size;
+    }
+
+    if (row_size == 0) {
+        archetype->chunk_capacity = UINT32_MAX;
+        archetype->chunk_size = 0;
+        return;
+    }
+
+    size_t padding = count * ECS_CHUNK_ALIGN;
+    size_t capacity = ECS_CHUNK_SIZE > padding + row_size
+        ? (ECS_CHUNK_SIZE - padding) / row_size
+        : 1;
+    size_t offset = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        columns[i].offset = offset;
+        offset += ECS_ALIGN_UP(columns[i].size * capacity, ECS_CHUNK_ALIGN);
+    }
+    archetype->chunk_capacity = capacity;
+    archetype->chunk_size = offset <= ECS_CHUNK_SIZE ? ECS_CHUNK_SIZE : offset;
+}
+
+// Columns must be added in the order of `archetype->type`. Tags (and pairs)
+// have no data: they only live in the type and get no column at all.
 void ecs_archetype_add_row(ecs_archetype_t *archetype, ecs_entity_t component, size_t size)
 {
-    ecs_vec_t col;
-    ecs_vec_init(&col, size);
-    ecs_sparseset_insert(&archetype->rows, component.value, &col);
-    ecs_vec_push(&archetype->type, &component.value);
-    ecs_vec_sort_u64(&archetype->type);
+    ecs_column_t column = { .size = size, .offset = 0 };
+
+    if (size == 0) {
+        return;
+    }
+    ecs_sparseset_insert(&archetype->rows, component.value, &column);
+    ecs_archetype_layout(archetype);
 }
 
 uint32_t ecs_archetype_add_entity(ecs_archetype_t *archetype, ecs_entity_t entity)
 {
-    ecs_vec_t *cols = archetype->rows.dense.data;
-    size_t cols_len = archetype->rows.dense.count;
+    uint32_t row = archetype->entities.count;
+    ecs_column_t *columns = archetype->rows.dense.data;
+    size_t columns_len = archetype->rows.dense.count;
+
+    if (archetype->chunk_size && row / archetype->chunk_capacity >= archetype->chunks.count) {
+        void *chunk = ecs_archetype_chunk_alloc(archetype);
+        ecs_vec_push(&archetype->chunks, &chunk);
+    }
+    for (size_t i = 0; i < columns_len; i++) {
+        void *dest = ecs_archetype_column_row(archetype, &columns[i], row);
+        if (dest) {
+            memset(dest, 0, columns[i].size);
+        }
+    }
+    ecs_vec_push(&archetype->entities, &entity);
+    return row;
+}
+
+// Reserves `count` rows in one go: chunks are allocated up front and every
+// column is zeroed with one memset per chunk instead of one per row.
+uint32_t ecs_archetype_add_entities(ecs_archetype_t *archetype, const ecs_entity_t *entities, uint32_t count)
+{
+    uint32_t row = archetype->entities.count;
+    ecs_column_t *columns = archetype->rows.dense.data;
+    size_t columns_len = archetype->rows.dense.count;
 
-    for (size_t i = 0; i < cols_len; i++) {
-        ecs_vec_push_zero(&cols[i]);
+    ecs_vec_push_batch(&archetype->entities, entities, count);
+    if (archetype->chunk_size == 0) {
+        return row;
+    }
+    while (archetype->chunks.count < ecs_archetype_chunk_count(archetype)) {
+        void *chunk = ecs_archetype_chunk_alloc(archetype);
+        ecs_vec_push(&archetype->chunks, &chunk);
+    }
+    for (size_t i = 0; i < columns_len; i++) {
+        ecs_archetype_column_write(archetype, &columns[i], row, count, NULL);
+    }
+    return row;
+}
+
+// Copies `count` contiguous values from `src` into a column, splitting the
+// copy at chunk boundaries. A NULL `src` zeroes the range instead.
+void ecs_archetype_column_write(
+    ecs_archetype_t *archetype,
+    const ecs_column_t *column,
+    uint32_t row,
+    uint32_t count,
+    const void *src
+) {
+    uint32_t capacity = archetype->chunk_capacity;
+
+    if (column->size == 0) {
+        return;
+    }
+    for (uint32_t done = 0; done < count;) {
+        uint32_t chunk_row = (row + done) % capacity;
+        uint32_t run = capacity - chunk_row < count - done ? capacity - chunk_row : count - done;
+        char *dest = ecs_archetype_column_row(archetype, column, row + done);
+
+        if (src) {
+            memcpy(dest, (const char *) src + (size_t) done * column->size, (size_t) run * column->size);
+        } else {
+            memset(dest, 0, (size_t) run * column->size);
+        }
+        done += run;
+    }
+}
+
+// Keeps one spare chunk past the last used one so that an entity bouncing
+// across a chunk boundary does not hit the pool every time.
+static void ecs_archetype_shrink_chunks(ecs_archetype_t *archetype)
+{
+    size_t needed = ecs_archetype_chunk_count(archetype) + 1;
+
+    while (archetype->chunks.count > needed) {
+        ecs_archetype_chunk_free(archetype, *ECS_VEC_GET_LAST(void *, &archetype->chunks));
+        ecs_vec_remove_last(&archetype->chunks);
     }
-    ecs_vec_push(&archetype->entities, &entity.index);
-    return archetype->entities.count - 1;
 }
 
 ecs_archetype_remove_result_t ecs_archetype_remove_entity(
@@ -56,24 +194,32 @@ ecs_archetype_remove_result_t ecs_archetype_remove_entity(
     size_t row
 ) {
     ecs_archetype_remove_result_t result = {0};
-    uint32_t *entities_data = (uint32_t *)archetype->entities.data;
+    ecs_entity_t *entities_data = archetype->entities.data;
+    size_t last = archetype->entities.count - 1;
 
-    if (row == archetype->entities.count - 1) {
+    if (row == last) {
         result.swapped_entity_new_row = UINT32_MAX;
     } else {
-        result.removed_entity_index = entities_data[archetype->entities.count - 1];
+        result.removed_entity_index = entities_data[last].index;
         result.swapped_entity_new_row = row;
-    }
-    ecs_vec_t *cols = (ecs_vec_t *)archetype->rows.dense.data;
-    size_t cols_count = archetype->rows.dense.count;
 
-    for (size_t i = 0; i < cols_count; i++) {
-        ecs_vec_remove_fast(&cols[i], row);
+        ecs_column_t *columns = archetype->rows.dense.data;
+        size_t columns_count = archetype->rows.dense.count;
+
+        for (size_t i = 0; i < columns_count; i++) {
+            void *dest = ecs_archetype_column_row(archetype, &columns[i], row);
+            if (dest) {
+                memcpy(dest, ecs_archetype_column_row(archetype, &columns[i], last), columns[i].size);
+            }
+        }
     }
     ecs_vec_remove_fast(&archetype->entities, row);
+    ecs_archetype_shrink_chunks(archetype);
     return result;
 }
 
+// Columns are walked through their component keys, which keep the type's
+// order, so tags never show up in the merge.
 void ecs_archetype_migrate_entity(
     ecs_archetype_t *src,
     ecs_archetype_t *dest,
@@ -82,25 +228,65 @@ void ecs_archetype_migrate_entity(
 ) {
     int src_len = src->rows.dense.count;
     int dest_len = dest->rows.dense.count;
-    ecs_vec_t *dest_rows = dest->rows.dense.data;
-    ecs_vec_t *src_rows = src->rows.dense.data;
+    ecs_column_t *dest_columns = dest->rows.dense.data;
+    ecs_column_t *src_columns = src->rows.dense.data;
 
-    ecs_entity_t *src_type = src->type.data;
-    ecs_entity_t *dest_type = dest->type.data;
+    uint64_t *src_keys = src->rows.dense_sparse_key.data;
+    uint64_t *dest_keys = dest->rows.dense_sparse_key.data;
 
     for (int src_i = 0, dest_i = 0; src_i < src_len && dest_i < dest_len;) {
-        if (src_type[src_i].value == dest_type[dest_i].value) {
-            ecs_vec_copy_element(
-                &src_rows[src_i],
-                &dest_rows[dest_i],
-                row, dest_row
+        if (src_keys[src_i] == dest_keys[dest_i]) {
+            memcpy(
+                ecs_archetype_column_row(dest, &dest_columns[dest_i], dest_row),
+                ecs_archetype_column_row(src, &src_columns[src_i], row),
+                dest_columns[dest_i].size
             );
             src_i++;
             dest_i++;
-        } else if (src_type[src_i].value < dest_type[dest_i].value) {
+        } else if (src_keys[src_i] < dest_keys[dest_i]) {
             src_i++;
         } else {
             dest_i++;
         }
     }
 }
+
+// Appends every row of `src` to `dest` and empties `src`. Shared columns are
+// copied with one memcpy per source chunk; returns the first row in `dest`.
+uint32_t ecs_archetype_move_entities(ecs_archetype_t *src, ecs_archetype_t *dest)
+{
+    uint32_t count = src->entities.count;
+    uint32_t dest_row = ecs_archetype_add_entities(dest, src->entities.data, count);
+    uint32_t chunk_count = ecs_archetype_chunk_count(src);
+    int src_len = src->rows.dense.count;
+    int dest_len = dest->rows.dense.count;
+    ecs_column_t *dest_columns = dest->rows.dense.data;
+    ecs_column_t *src_columns = src->rows.dense.data;
+
+    uint64_t *src_keys = src->rows.dense_sparse_key.data;
+    uint64_t *dest_keys = dest->rows.dense_sparse_key.data;
+
+    for (int src_i = 0, dest_i = 0; src_i < src_len && dest_i < dest_len;) {
+        if (src_keys[src_i] == dest_keys[dest_i]) {
+            for (uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+                ecs_archetype_column_write(
+                    dest,
+                    &dest_columns[dest_i],
+                    dest_row + chunk * src->chunk_capacity,
+                    ecs_archetype_chunk_rows(src, chunk),
+                    ecs_archetype_chunk_column(src, chunk, &src_columns[src_i])
+                );
+            }
+            src_i++;
+            dest_i++;
+        } else if (src_keys[src_i] < dest_keys[dest_i]) {
+            src_i++;
+        } else {
+            dest_i++;
+        }
+    }
+
+    src->entities.count = 0;
+    ecs_archetype_shrink_chunks(src);
+    return dest_row;
+}
@@ -1,5 +1,7 @@
 #ifndef ECS_ARCHETYPE_H
     #define ECS_ARCHETYPE_H
+    #include "datastructure/ecs_chunk_pool.h"
+    #include "datastructure/ecs_smallmap.h"
     #include "datastructure/ecs_sparseset.h"
     #include "datastructure/ecs_vec.h"
     #include "ecs_config.h"
@@ -16,30 +18,106 @@ typedef struct {
 } ecs_archetype_remove_result_t;
 
 typedef struct {
-    ecs_sparseset_t rows;
-    ecs_vec_t entities;
-    ecs_type_t type;
+    uint32_t size;
+    uint32_t offset; // byte offset of the column inside every chunk
+    uint32_t change_tick; // world tick of the last write to the column
+} ecs_column_t;
 
-    ecs_sparseset_t add_edge;
-    ecs_sparseset_t remove_edge;
+typedef struct {
+    uint32_t query;
+    uint32_t index; // position of the archetype in that query's cache
+} ecs_archetype_query_ref_t;
+
+typedef struct {
+    ecs_entity_t event;
+    uint32_t hook; // index in the event's observer hooks
+} ecs_archetype_observer_ref_t;
+
+// Rows live in fixed-size chunks: each chunk holds `chunk_capacity` rows of
+// every column, laid out column after column. Chunks are never reallocated,
+// so component pointers stay valid while the table grows.
+typedef struct {
+    ecs_sparseset_t rows; // <component, ecs_column_t>
+    ecs_vec_t chunks; // void *
+    ecs_vec_t entities; // ecs_entity_t
+    const ecs_type_info_t *type;
+    ecs_chunk_pool_t *chunk_pool;
+    uint32_t chunk_capacity;
+    uint32_t chunk_size;
+
+    ecs_smallmap_t add_edge; // <component, ecs_archetype_id_t>
+    ecs_smallmap_t remove_edge; // <component, ecs_archetype_id_t>
+    ecs_vec_t query_refs; // ecs_archetype_query_ref_t
+    ecs_vec_t observer_refs; // ecs_archetype_observer_ref_t, observers whose query matches the table
+    uint64_t empty_since; // world frame at which the table last became empty
 } ecs_archetype_t;
 
-void ecs_archetype_init(ecs_archetype_t *archetype);
+void ecs_archetype_init(ecs_archetype_t *archetype, const ecs_type_info_t *type, ecs_chunk_pool_t *chunk_pool);
 void ecs_archetype_add_row(ecs_archetype_t *archetype, ecs_entity_t component, size_t size);
 void ecs_archetype_add_singleton(ecs_archetype_t *archetype, ecs_entity_t component);
 uint32_t ecs_archetype_add_entity(ecs_archetype_t *archetype, ecs_entity_t entity);
+uint32_t ecs_archetype_add_entities(ecs_archetype_t *archetype, const ecs_entity_t *entities, uint32_t count);
+void ecs_archetype_column_write(ecs_archetype_t *archetype, const ecs_column_t *column, uint32_t row, uint32_t count, const void *src);
 ecs_archetype_remove_result_t ecs_archetype_remove_entity(ecs_archetype_t *archetype, size_t row);
 void ecs_archetype_fini(ecs_archetype_t *archetype);
 void ecs_archetype_migrate_entity(ecs_archetype_t *src, ecs_archetype_t *dest, size_t row, size_t dest_row);
+uint32_t ecs_archetype_move_entities(ecs_archetype_t *src, ecs_archetype_t *dest);
+
+// Reclaimed archetypes keep their slot (and id) until it is recycled.
+ECS_INLINE
+bool ecs_archetype_is_alive(const ecs_archetype_t *archetype) {
+    return archetype->type != NULL;
+}
+
+ECS_INLINE
+uint32_t ecs_archetype_chunk_count(const ecs_archetype_t *archetype) {
+    uint64_t count = archetype->entities.count;
+    return count ? (count - 1) / archetype->chunk_capacity + 1 : 0;
+}
+
+ECS_INLINE
+uint32_t ecs_archetype_chunk_rows(const ecs_archetype_t *archetype, uint32_t chunk) {
+    uint64_t first = (uint64_t) chunk * archetype->chunk_capacity;
+    uint64_t left = archetype->entities.count - first;
+    return left < archetype->chunk_capacity ? left : archetype->chunk_capacity;
+}
+
+ECS_INLINE
+void *ecs_archetype_chunk_column(ecs_archetype_t *archetype, uint32_t chunk, const ecs_column_t *column) {
+    if (ECS_UNLIKELY(archetype->chunk_size == 0)) {
+        return NULL;
+    }
+    return (char *) *ECS_VEC_GET(void *, &archetype->chunks, chunk) + column->offset;
+}
+
+ECS_INLINE
+void *ecs_archetype_column_row(ecs_archetype_t *archetype, const ecs_column_t *column, size_t row) {
+    uint32_t chunk = row / archetype->chunk_capacity;
+    uint32_t chunk_row = row % archetype->chunk_capacity;
+    char *data = ecs_archetype_chunk_column(archetype, chunk, column);
+
+    return data ? data + (size_t) chunk_row * column->size : NULL;
+}
 
 ECS_INLINE
 void *ecs_archetype_get_component(ecs_archetype_t *archetype, size_t row, ecs_entity_t component) {
-    return ECS_VEC_GET(void, (ecs_vec_t *) ecs_sparseset_get(&archetype->rows, component.value), row);
+    ecs_column_t *column = ecs_sparseset_get(&archetype->rows, component.value);
+
+    return column ? ecs_archetype_column_row(archetype, column, row) : NULL;
+}
+
+// Marks every column as written at `tick`, for rows that moved in.
+ECS_INLINE
+void ecs_archetype_touch(ecs_archetype_t *archetype, uint32_t tick) {
+    iter_vec(ecs_column_t, &archetype->rows.dense) {
+        iter_value.change_tick = tick;
+    }
 }
 
+// Tags have no column, so membership is answered by the type.
 ECS_INLINE
 bool ecs_archetype_has_component(ecs_archetype_t *archetype, ecs_entity_t component) {
-    return ecs_sparseset_exists(&archetype->rows, component.value);
+    return ecs_type_info_has(archetype->type, component);
 }
 
 #endif
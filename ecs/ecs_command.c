@@ -0,0 +1,269 @@
+#include "ecs_command.h"
+#include "ecs_archetype.h"
+#include "ecs_types.h"
+#include "ecs_vec.h"
+#include <ecs_world.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Stage of the system running on this thread, NULL outside of systems.
+static _Thread_local ecs_command_buffer_t *ecs_thread_stage = NULL;
+
+void ecs_command_buffer_init(ecs_command_buffer_t *buffer) {
+    buffer->commands = (ecs_vec_t) { .size = sizeof(ecs_command_t) };
+    buffer->values = (ecs_vec_t) { .size = sizeof(uint8_t) };
+    buffer->tick = 0;
+}
+
+void ecs_command_buffer_fini(ecs_command_buffer_t *buffer) {
+    ecs_vec_free(&buffer->commands);
+    ecs_vec_free(&buffer->values);
+}
+
+void ecs_command_buffer_push(
+    ecs_command_buffer_t *buffer,
+    ecs_command_kind_t kind,
+    ecs_entity_t entity,
+    ecs_entity_t component,
+    const void *value,
+    size_t size
+) {
+    ecs_command_t command = {
+        .entity = entity,
+        .component = component,
+        .kind = kind,
+        .sequence = buffer->commands.count,
+        .value_offset = buffer->values.count,
+        .value_size = value ? size : 0,
+    };
+
+    if (value != NULL && size) {
+        ecs_vec_push_batch(&buffer->values, value, size);
+    }
+    ecs_vec_push(&buffer->commands, &command);
+}
+
+static int ecs_command_compare(const void *a, const void *b) {
+    const ecs_command_t *left = a;
+    const ecs_command_t *right = b;
+
+    if (left->entity.value != right->entity.value) {
+        return left->entity.value < right->entity.value ? -1 : 1;
+    }
+    return (left->sequence > right->sequence) - (left->sequence < right->sequence);
+}
+
+// Fires the hooks of the components in `type` but not in `other`; the
+// entity stays put until all of them have run.
+static void ecs_command_fire_hooks(
+    ecs_world_t *world,
+    ecs_entity_t entity,
+    const ecs_type_info_t *type,
+    const ecs_type_info_t *other,
+    bool add
+) {
+    ecs_defer_begin(world);
+    iter_vec(ecs_entity_t, &type->ids) {
+        if (ecs_type_info_has(other, iter_value)) {
+            continue;
+        }
+        ecs_component_record_t *component_record = ecs_component_get_record(world, iter_value);
+        ecs_component_hook_call hook = NULL;
+
+        if (component_record) {
+            hook = add ? component_record->on_add : component_record->on_remove;
+        }
+        if (hook) {
+            ecs_world_entity_hook(world, hook, iter_value, entity);
+        }
+    }
+    ecs_defer_end(world);
+}
+
+static ecs_archetype_id_t ecs_command_dest(
+    ecs_world_t *world,
+    ecs_archetype_id_t src_id,
+    const ecs_command_t *commands,
+    uint32_t count
+) {
+    ecs_archetype_id_t dest_id = src_id;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (ecs_world_sparse_storage(world, commands[i].component)) {
+            continue;
+        }
+        bool present = ecs_type_info_has(ecs_world_get_archetype(world, dest_id)->type, commands[i].component);
+
+        if (commands[i].kind == EcsCommandRemove) {
+            if (present) {
+                dest_id = ecs_world_edge_remove(world, dest_id, commands[i].component);
+            }
+        } else if (!present) {
+            // a set implies an add
+            dest_id = ecs_world_edge_add(world, dest_id, commands[i].component);
+        }
+    }
+    return dest_id;
+}
+
+// Sparse components don't move the entity, their commands apply in order.
+static void ecs_command_apply_sparse(
+    ecs_world_t *world,
+    const ecs_command_buffer_t *buffer,
+    const ecs_command_t *commands,
+    uint32_t count
+) {
+    for (uint32_t i = 0; i < count && ecs_is_alive(world, commands[i].entity); i++) {
+        if (!ecs_world_sparse_storage(world, commands[i].component)) {
+            continue;
+        }
+        if (commands[i].kind == EcsCommandAdd) {
+            ecs_add(world, commands[i].entity, commands[i].component);
+        } else if (commands[i].kind == EcsCommandRemove) {
+            ecs_remove(world, commands[i].entity, commands[i].component);
+        } else {
+            ecs_world_sparse_set(world, commands[i].entity, commands[i].component,
+                ECS_VEC_GET(uint8_t, &buffer->values, commands[i].value_offset));
+        }
+    }
+}
+
+// Applies every command recorded for one entity: the final table is found by
+// walking the graph edges, then the entity moves there in a single step.
+static void ecs_command_apply_entity(
+    ecs_world_t *world,
+    const ecs_command_buffer_t *buffer,
+    const ecs_command_t *commands,
+    uint32_t count
+) {
+    ecs_entity_t entity = commands[0].entity;
+
+    if (!ecs_is_alive(world, entity)) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (commands[i].kind == EcsCommandKill) {
+            ecs_kill(world, entity);
+            return;
+        }
+    }
+
+    ecs_command_apply_sparse(world, buffer, commands, count);
+    if (!ecs_is_alive(world, entity)) {
+        return;
+    }
+
+    ecs_entity_record_t *record = ecs_world_get_record(world, entity);
+    ecs_archetype_id_t src_id = record->archetype_id;
+    ecs_archetype_id_t dest_id = ecs_command_dest(world, src_id, commands, count);
+
+    if (dest_id != src_id) {
+        // remove hooks run first, while the components are still there
+        ecs_command_fire_hooks(world, entity, ecs_world_get_archetype(world, src_id)->type,
+            ecs_world_get_archetype(world, dest_id)->type, false);
+        if (!ecs_is_alive(world, entity)) {
+            return;
+        }
+        src_id = record->archetype_id;
+        dest_id = ecs_command_dest(world, src_id, commands, count);
+    }
+    if (dest_id != src_id) {
+        const ecs_type_info_t *src_type = ecs_world_get_archetype(world, src_id)->type;
+        const ecs_type_info_t *dest_type = ecs_world_get_archetype(world, dest_id)->type;
+
+        ecs_world_move_entity(world, entity, dest_id);
+        ecs_command_fire_hooks(world, entity, dest_type, src_type, true);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (commands[i].kind != EcsCommandSet || !ecs_is_alive(world, entity)
+            || ecs_world_sparse_storage(world, commands[i].component)
+            || !ecs_has(world, entity, commands[i].component)) {
+            continue;
+        }
+        ecs_set(world, entity, commands[i].component,
+            ECS_VEC_GET(uint8_t, &buffer->values, commands[i].value_offset));
+    }
+}
+
+static void ecs_command_buffer_apply(ecs_world_t *world, ecs_command_buffer_t *buffer) {
+    ecs_command_t *commands = buffer->commands.data;
+    uint32_t count = buffer->commands.count;
+
+    qsort(commands, count, sizeof(ecs_command_t), ecs_command_compare);
+    for (uint32_t i = 0; i < count;) {
+        uint32_t end = i + 1;
+
+        while (end < count && commands[end].entity.value == commands[i].entity.value) {
+            end++;
+        }
+        ecs_command_apply_entity(world, buffer, commands + i, end - i);
+        i = end;
+    }
+}
+
+// Must run while the world is not deferred: hooks fired here apply their own
+// changes immediately, or record them into another stage.
+void ecs_command_buffer_flush(ecs_world_t *world, ecs_command_buffer_t *buffer) {
+    while (buffer->commands.count) {
+        // hooks may record into this buffer while it is applied
+        ecs_command_buffer_t pending = *buffer;
+
+        ecs_command_buffer_init(buffer);
+        ecs_command_buffer_apply(world, &pending);
+        if (buffer->commands.count == 0) {
+            // keep the storage for the next frame
+            ecs_command_buffer_fini(buffer);
+            pending.commands.count = 0;
+            pending.values.count = 0;
+            *buffer = pending;
+            return;
+        }
+        ecs_command_buffer_fini(&pending);
+    }
+}
+
+void ecs_defer_begin(ecs_world_t *world) {
+    world->defer_depth++;
+}
+
+void ecs_defer_end(ecs_world_t *world) {
+    if (--world->defer_depth == 0) {
+        ecs_command_buffer_flush(world, &world->commands);
+    }
+}
+
+bool ecs_is_deferred(const ecs_world_t *world) {
+    return world->defer_depth > 0;
+}
+
+ecs_command_buffer_t *ecs_defer_stage(ecs_world_t *world) {
+    return ecs_thread_stage ? ecs_thread_stage : &world->commands;
+}
+
+// Stage of the system running on this thread, NULL outside of systems.
+ecs_command_buffer_t *ecs_defer_thread_stage(void) {
+    return ecs_thread_stage;
+}
+
+// Returns the stage that was current, so callers can restore it.
+ecs_command_buffer_t *ecs_defer_set_stage(ecs_command_buffer_t *stage) {
+    ecs_command_buffer_t *previous = ecs_thread_stage;
+
+    ecs_thread_stage = stage;
+    return previous;
+}
+
+// Moves the commands of `src` to the end of `dest`, keeping their order.
+void ecs_command_buffer_append(ecs_command_buffer_t *dest, ecs_command_buffer_t *src) {
+    iter_vec(ecs_command_t, &src->commands) {
+        const void *value = iter_value.value_size
+            ? ECS_VEC_GET(uint8_t, &src->values, iter_value.value_offset)
+            : NULL;
+
+        ecs_command_buffer_push(dest, iter_value.kind, iter_value.entity, iter_value.component,
+            value, iter_value.value_size);
+    }
+    src->commands.count = 0;
+    src->values.count = 0;
+}
@@ -0,0 +1,53 @@
+#ifndef ECS_COMMAND_H
+    #define ECS_COMMAND_H
+    #include "datastructure/ecs_vec.h"
+    #include "ecs_types.h"
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+
+typedef enum {
+    EcsCommandAdd,
+    EcsCommandRemove,
+    EcsCommandSet,
+    EcsCommandKill
+} ecs_command_kind_t;
+
+typedef struct {
+    ecs_entity_t entity;
+    ecs_entity_t component;
+    ecs_command_kind_t kind;
+    uint32_t sequence; // recording order, kept stable when grouping by entity
+    uint32_t value_offset; // into the buffer values, for sets
+    uint32_t value_size;
+} ecs_command_t;
+
+// Structural changes recorded while the world is deferred. Flushing groups
+// them per entity so that each entity moves tables at most once.
+typedef struct {
+    ecs_vec_t commands; // ecs_command_t
+    ecs_vec_t values; // raw bytes of the set values
+    uint32_t tick; // change tick of the system recording into it, 0 otherwise
+} ecs_command_buffer_t;
+
+void ecs_command_buffer_init(ecs_command_buffer_t *buffer);
+void ecs_command_buffer_fini(ecs_command_buffer_t *buffer);
+void ecs_command_buffer_push(
+    ecs_command_buffer_t *buffer,
+    ecs_command_kind_t kind,
+    ecs_entity_t entity,
+    ecs_entity_t component,
+    const void *value,
+    size_t size
+);
+void ecs_command_buffer_flush(ecs_world_t *world, ecs_command_buffer_t *buffer);
+void ecs_command_buffer_append(ecs_command_buffer_t *dest, ecs_command_buffer_t *src);
+
+void ecs_defer_begin(ecs_world_t *world);
+void ecs_defer_end(ecs_world_t *world);
+bool ecs_is_deferred(const ecs_world_t *world);
+ecs_command_buffer_t *ecs_defer_stage(ecs_world_t *world);
+ecs_command_buffer_t *ecs_defer_set_stage(ecs_command_buffer_t *stage);
+ecs_command_buffer_t *ecs_defer_thread_stage(void);
+
+#endif
@@ -4,9 +4,11 @@
 #include <stdio.h>
 
 void ecs_print_id(ecs_world_t *world, ecs_entity_t entity) {
-    if (!ecs_has(world, entity, ecs_id(EcsName))) return;
+    ecs_entity_t named = ecs_is_pair(entity) ? ecs_pair_relation(entity) : entity;
 
-    char **name = ecs_get(world, entity, ecs_id(EcsName));
+    if (!ecs_has(world, named, ecs_id(EcsName))) return;
+
+    char **name = ecs_get(world, named, ecs_id(EcsName));
     if (ecs_is_pair(entity)) {
         ecs_entity_t target = ecs_pair_target(entity);
         if (ecs_has(world, target, ecs_id(EcsName))) {
@@ -20,7 +22,7 @@ void ecs_print_id(ecs_world_t *world, ecs_entity_t entity) {
     printf("%s", *name);
 }
 
-void ecs_print_type(ecs_world_t *world, ecs_type_t *type) {
+void ecs_print_type(ecs_world_t *world, const ecs_type_t *type) {
     printf("(");
     iter_vec(ecs_entity_t, type) {
         ecs_print_id(world, iter_value);
@@ -49,8 +51,8 @@ void ecs_print_queryid(ecs_world_t *world, EcsQueryId id) {
     ecs_print_query(world, &cache->query);
 }
 
-ecs_type_t *ecs_entity_type(ecs_world_t *world, ecs_entity_t entity) {
-    return &ecs_world_get_entity_archetype(world, entity)->type;
+const ecs_type_t *ecs_entity_type(ecs_world_t *world, ecs_entity_t entity) {
+    return &ecs_world_get_entity_archetype(world, entity)->type->ids;
 }
 
 void ecs_print_it(ecs_iter_t *it) {
@@ -76,6 +78,6 @@ void ecs_print_entity(ecs_world_t *world, ecs_entity_t entity) {
 void ecs_archetype_print(ecs_archetype_t *archetype)
 {
     printf("Archetype: ");
-    ecs_vec_print_type(&archetype->type);
+    ecs_vec_print_type(&archetype->type->ids);
     printf("\n");
 }
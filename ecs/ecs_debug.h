@@ -3,7 +3,7 @@
     #include <ecs_world.h>
 
 void ecs_print_id(ecs_world_t *world, ecs_entity_t entity);
-void ecs_print_type(ecs_world_t *world, ecs_type_t *type);
+void ecs_print_type(ecs_world_t *world, const ecs_type_t *type);
 void ecs_print_entity(ecs_world_t *world, ecs_entity_t entity);
 
 void ecs_print_query(ecs_world_t *world, ecs_query_t *query);
@@ -12,6 +12,6 @@ void ecs_print_queryid(ecs_world_t *world, EcsQueryId id);
 void ecs_archetype_print(ecs_archetype_t *archetype);
 
 void ecs_print_it(ecs_iter_t *it);
-ecs_type_t *ecs_entity_type(ecs_world_t *world, ecs_entity_t entity);
+const ecs_type_t *ecs_entity_type(ecs_world_t *world, ecs_entity_t entity);
 
 #endif
@@ -3,58 +3,74 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "ecs_entity.h"
 
+_Static_assert(sizeof(ecs_entity_record_t) == 16, "entity records must stay 16 bytes");
 
 void ecs_entity_manager_init(ecs_entity_manager_t *manager) {
-    ecs_vec_init(&manager->entity_record, sizeof(ecs_entity_record_t));
-    ecs_vec_init(&manager->generations, sizeof(uint16_t));
-    ecs_vec_init(&manager->available_entity, sizeof(uint32_t));
+    ecs_vec_init(&manager->pages, sizeof(ecs_entity_record_t *));
+    manager->count = 0;
+    manager->free_head = ECS_ENTITY_NO_FREE;
 }
 
 void ecs_entity_manager_fini(ecs_entity_manager_t *manager) {
-    ecs_vec_free(&manager->entity_record);
-    ecs_vec_free(&manager->generations);
-    ecs_vec_free(&manager->available_entity);
+    iter_vec(ecs_entity_record_t *, &manager->pages) {
+        free(iter_value);
+    }
+    ecs_vec_free(&manager->pages);
+    manager->count = 0;
+    manager->free_head = ECS_ENTITY_NO_FREE;
 }
 
 ecs_entity_t ecs_entity_manager_get_entity(ecs_entity_manager_t *manager, uint32_t index) {
     ecs_entity_t entity = { .index = index, .gen = 0 };
-    entity.gen = *ECS_VEC_GET(uint16_t, &manager->generations, index);
+
+    if (index < manager->count) {
+        entity.gen = ecs_entity_manager_record(manager, index)->gen;
+    }
     return entity;
 }
 
 ecs_entity_t ecs_entity_manager_new(ecs_entity_manager_t *manager) {
-    ecs_entity_t entity;
-
-    if (manager->available_entity.count > 0) {
-        entity.index = *ECS_VEC_GET_LAST(uint32_t, &manager->available_entity);
-        entity.gen = *ECS_VEC_GET(uint16_t, &manager->generations, entity.index);
-        ecs_vec_set(&manager->entity_record, entity.index, &(ecs_entity_record_t) {
-            .archetype_id = 0
-        });
-        ecs_vec_remove_last(&manager->available_entity);
-        return entity;
+    ecs_entity_record_t *record;
+    uint32_t index;
+
+    if (manager->free_head != ECS_ENTITY_NO_FREE) {
+        index = manager->free_head;
+        record = ecs_entity_manager_record(manager, index);
+        manager->free_head = record->next_free;
+    } else {
+        index = manager->count++;
+        if ((index >> ECS_ENTITY_PAGE_BITS) >= manager->pages.count) {
+            ecs_entity_record_t *page = malloc(ECS_ENTITY_PAGE_SIZE * sizeof(ecs_entity_record_t));
+            ecs_vec_push(&manager->pages, &page);
+        }
+        record = ecs_entity_manager_record(manager, index);
+        record->gen = 0;
     }
-    entity.index = manager->generations.count;
-    entity.gen = 0;
-    ecs_vec_push(&manager->entity_record, &(ecs_entity_record_t) {
-        .row = 0,
-        .archetype_id = 0
-    });
-    ecs_vec_push(&manager->generations, &(uint16_t) {0});
-    return entity;
+
+    record->archetype_id = 0;
+    record->row = 0;
+    record->flags = ECS_RECORD_ALIVE;
+    record->next_free = ECS_ENTITY_NO_FREE;
+    return (ecs_entity_t) { .index = index, .gen = record->gen };
 }
 
 bool ecs_entity_manager_is_alive(ecs_entity_manager_t *manager, ecs_entity_t e) {
-    if (e.index >= manager->generations.count) {
+    if (e.index >= manager->count) {
         return false;
     }
-    return e.gen == *ECS_VEC_GET(uint16_t, &manager->generations, e.index);
+
+    ecs_entity_record_t *record = ecs_entity_manager_record(manager, e.index);
+    return record->gen == e.gen && (record->flags & ECS_RECORD_ALIVE);
 }
 
 void ecs_entity_manager_kill(ecs_entity_manager_t *manager, uint32_t index) {
-    ecs_vec_push(&manager->available_entity, &index);
-    uint16_t gen = (*ECS_VEC_GET(uint16_t, &manager->generations, index)) + 1;
-    ecs_vec_set(&manager->generations, index, &gen);
+    ecs_entity_record_t *record = ecs_entity_manager_record(manager, index);
+
+    record->gen++;
+    record->flags &= ~ECS_RECORD_ALIVE;
+    record->next_free = manager->free_head;
+    manager->free_head = index;
 }
@@ -5,17 +5,31 @@
     #include "ecs_types.h"
     #include <stdint.h>
     #include <stdbool.h>
-    #define ECS_GET_RECORD(world, e) ECS_VEC_GET(ecs_entity_record_t, &(world)->entity_manager.entity_record, e.index)
+    #define ECS_GET_RECORD(world, e) ecs_entity_manager_record(&(world)->entity_manager, (e).index)
 
+    #define ECS_ENTITY_PAGE_BITS 12
+    #define ECS_ENTITY_PAGE_SIZE (1 << ECS_ENTITY_PAGE_BITS)
+    #define ECS_ENTITY_PAGE_MASK (ECS_ENTITY_PAGE_SIZE - 1)
+    #define ECS_ENTITY_NO_FREE UINT32_MAX
+    #define ECS_RECORD_ALIVE 0x1
+
+// One 16-byte slot per entity index: the location sits next to the
+// generation, so a liveness check and a component lookup share a cache line.
+// Dead slots chain into the free list through `next_free`.
 typedef struct {
     ecs_archetype_id_t archetype_id;
     uint32_t row;
+    uint16_t gen;
+    uint16_t flags;
+    uint32_t next_free;
 } ecs_entity_record_t;
 
+// Slots live in fixed-size pages that are never reallocated, so record
+// pointers stay valid while the index grows.
 typedef struct {
-    ecs_vec_t generations;
-    ecs_vec_t entity_record;
-    ecs_vec_t available_entity;
+    ecs_vec_t pages; // ecs_entity_record_t *
+    uint32_t count; // slots handed out so far
+    uint32_t free_head;
 } ecs_entity_manager_t;
 
 void ecs_entity_manager_init(ecs_entity_manager_t *manager);
@@ -25,4 +39,10 @@ void ecs_entity_manager_kill(ecs_entity_manager_t *manager, uint32_t index);
 void ecs_entity_manager_fini(ecs_entity_manager_t *manager);
 ecs_entity_t ecs_entity_manager_get_entity(ecs_entity_manager_t *manager, uint32_t index);
 
+ECS_INLINE
+ecs_entity_record_t *ecs_entity_manager_record(const ecs_entity_manager_t *manager, uint32_t index) {
+    ecs_entity_record_t *page = ((ecs_entity_record_t **) manager->pages.data)[index >> ECS_ENTITY_PAGE_BITS];
+    return &page[index & ECS_ENTITY_PAGE_MASK];
+}
+
 #endif
@@ -1,4 +1,5 @@
 #include "ecs_component_storage.h"
+#include "ecs_archetype.h"
 #include "ecs_query.h"
 #include "ecs_vec.h"
 #include "ecs_world.h"
@@ -20,27 +21,83 @@ void ecs_observer_fini(ecs_observer_t *observer) {
     ecs_vec_free(&observer->hooks);
 }
 
+// Only the observers cached on the target's table are visited, and the
+// callback sees the target's row alone.
 void ecs_observer_trigger(ecs_world_t *world, ecs_entity_t event, ecs_entity_t target) {
     ecs_component_record_t *record = ecs_component_storage_get_component_record(&world->component_storage, event);
+    ecs_entity_record_t *target_record = ecs_world_get_record(world, target);
+    ecs_archetype_id_t archetype_id = target_record->archetype_id;
 
-    ecs_observer_record_t *records = record->observer.hooks.data;
-    uint32_t count = record->observer.hooks.count;
+    // callbacks may create tables, which moves the archetype array, and a
+    // target that changed table no longer matches the remaining observers
+    for (uint32_t i = 0; target_record->archetype_id == archetype_id; i++) {
+        ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+        uint32_t row = target_record->row;
 
+        if (i >= archetype->observer_refs.count) {
+            break;
+        }
+        ecs_archetype_observer_ref_t ref = *ECS_VEC_GET(ecs_archetype_observer_ref_t, &archetype->observer_refs, i);
+
+        if (ref.event.value != event.value) {
+            continue;
+        }
+        ecs_observer_record_t *hook = ECS_VEC_GET(ecs_observer_record_t, &record->observer.hooks, ref.hook);
+        ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, hook->query);
+        ecs_iter_t it = {
+            .world = world,
+            .query = &cache->query,
+            .archetypes = &cache->archetypes,
+            .active_count = &cache->active_count,
+            .archetype_p = archetype,
+            .current_archetype = -1,
+            .current_chunk = row / archetype->chunk_capacity,
+            .offset = row,
+            .count = 1,
+        };
+
+        ecs_entity_t ids[ECS_QUERY_TERM_COUNT] = {0};
+        bool matched = true;
+
+        it.ids = ids;
+        for (uint32_t t = 0; t < ECS_QUERY_TERM_COUNT && cache->query.terms[t].id.value; t++) {
+            const ecs_query_term_t *term = &cache->query.terms[t];
 
-    for (uint32_t i = 0; i < count; i++) {
-        EcsQueryId query = records[i].query;
-        ecs_iter_t it = ecs_query_iter(world, query);
-        while (ecs_iter_next(&it)) {
-            records[i].call(world, target, &it);
+            // the table matched, sparse terms still depend on the target
+            if (term->flags & EcsQueryFlagSparse) {
+                ecs_sparseset_t *sparse = ecs_world_sparse_storage(world, term->id);
+
+                ids[t] = term->id;
+                it.columns[t] = ecs_sparseset_get(sparse, target.index);
+                matched &= ecs_sparseset_exists(sparse, target.index) != (term->oper == EcsQueryOperNot);
+                continue;
+            }
+            ids[t] = ecs_query_term_match(archetype->type, term->id);
+            ecs_column_t *column = ids[t].value ? ecs_sparseset_get(&archetype->rows, ids[t].value) : NULL;
+            it.columns[t] = column ? ecs_archetype_column_row(archetype, column, row) : NULL;
+        }
+        if (matched) {
+            hook->call(world, target, &it);
         }
     }
 }
 
+// The observer is cached on every table its query matches, now and later.
 void ecs_observe(ecs_world_t *world, ecs_entity_t event, ecs_observer_call_t call, ecs_query_t *query) {
     ecs_component_record_t *record = ecs_component_storage_get_component_record(&world->component_storage, event);
     ecs_observer_record_t observer_record = {
         .call = call,
         .query = ecs_query_register(world, query)
     };
+    ecs_archetype_observer_ref_t ref = {
+        .event = event,
+        .hook = record->observer.hooks.count,
+    };
+    ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, observer_record.query);
+
     ecs_vec_push(&record->observer.hooks, &observer_record);
+    ecs_vec_push(&cache->observers, &ref);
+    iter_vec(ecs_query_match_t, &cache->archetypes) {
+        ecs_vec_push(&ecs_world_get_archetype(world, iter_value.archetype)->observer_refs, &ref);
+    }
 }
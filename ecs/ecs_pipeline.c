@@ -0,0 +1,263 @@
+#include "ecs_pipeline.h"
+#include "ecs_query.h"
+#include "ecs_system.h"
+#include "ecs_types.h"
+#include "ecs_vec.h"
+#include <ecs_world.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+void ecs_pipeline_init(ecs_pipeline_t *pipeline) {
+    pipeline->systems = (ecs_vec_t) { .size = sizeof(ecs_pipeline_system_t) };
+    pipeline->phase_ends = (ecs_vec_t) { .size = sizeof(uint32_t) };
+    pipeline->system_query = 0;
+    pipeline->phase_query = 0;
+    pipeline->system_count = 0;
+    ecs_sparseset_init(&pipeline->phases, sizeof(ecs_pipeline_phase_t));
+    pipeline->phase_count = 0;
+    pipeline->dirty = true;
+}
+
+void ecs_pipeline_fini(ecs_pipeline_t *pipeline) {
+    ecs_vec_free(&pipeline->systems);
+    ecs_vec_free(&pipeline->phase_ends);
+    ecs_sparseset_fini(&pipeline->phases);
+}
+
+void ecs_pipeline_invalidate(ecs_world_t *world) {
+    world->pipeline.dirty = true;
+}
+
+// Numbers a phase the first time it is tagged EcsPhase or given a system.
+// Like systems, phases are ordered by it: entity indices are recycled.
+uint32_t ecs_pipeline_phase_order(ecs_world_t *world, ecs_entity_t phase) {
+    ecs_pipeline_t *pipeline = &world->pipeline;
+    ecs_pipeline_phase_t *entry = ecs_sparseset_get(&pipeline->phases, phase.index);
+
+    if (entry == NULL || entry->entity.value != phase.value) {
+        ecs_pipeline_phase_t created = { .entity = phase, .order = pipeline->phase_count++ };
+        ecs_sparseset_insert(&pipeline->phases, phase.index, &created);
+        return created.order;
+    }
+    return entry->order;
+}
+
+static bool ecs_pipeline_is_pair_of(ecs_entity_t id, ecs_entity_t relation) {
+    return ecs_is_pair(id)
+        && id.relation.relation == relation.index
+        && id.relation.target != ecs_id(EcsWildcard).index;
+}
+
+static uint32_t ecs_pipeline_phase_position(const ecs_vec_t *phases, uint32_t phase) {
+    iter_vec(uint32_t, phases) {
+        if (iter_value == phase) {
+            return __index;
+        }
+    }
+    return UINT32_MAX;
+}
+
+static int ecs_pipeline_compare_phase(const void *a, const void *b) {
+    const ecs_pipeline_phase_t *left = a;
+    const ecs_pipeline_phase_t *right = b;
+
+    return (left->order > right->order) - (left->order < right->order);
+}
+
+// Oldest phase first, so that Kahn's algorithm breaks ties by creation.
+static void ecs_pipeline_sort_by_creation(ecs_world_t *world, ecs_vec_t *phases) {
+    uint32_t *phase_data = phases->data;
+    ecs_pipeline_phase_t *sorted = malloc((phases->count + 1) * sizeof(ecs_pipeline_phase_t));
+
+    for (uint32_t i = 0; i < phases->count; i++) {
+        sorted[i].entity = ecs_entity_manager_get_entity(&world->entity_manager, phase_data[i]);
+        sorted[i].order = ecs_pipeline_phase_order(world, sorted[i].entity);
+    }
+    qsort(sorted, phases->count, sizeof(ecs_pipeline_phase_t), ecs_pipeline_compare_phase);
+    for (uint32_t i = 0; i < phases->count; i++) {
+        phase_data[i] = sorted[i].entity.index;
+    }
+    free(sorted);
+}
+
+static int ecs_pipeline_compare_system(const void *a, const void *b) {
+    const ecs_pipeline_system_t *left = a;
+    const ecs_pipeline_system_t *right = b;
+
+    // entity indices are recycled, so they don't tell which system is older
+    return (left->order > right->order) - (left->order < right->order);
+}
+
+// Two systems conflict when a column written by one is used by the other.
+// Tags have no column, so they never conflict.
+static bool ecs_pipeline_conflicts(ecs_world_t *world, const ecs_query_t *a, const ecs_query_t *b) {
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT && a->terms[i].id.value; i++) {
+        const ecs_query_term_t *left = &a->terms[i];
+
+        if (left->oper == EcsQueryOperNot
+            || !ecs_component_storage_get_component_size(&world->component_storage, left->id)) {
+            continue;
+        }
+        for (uint32_t j = 0; j < ECS_QUERY_TERM_COUNT && b->terms[j].id.value; j++) {
+            const ecs_query_term_t *right = &b->terms[j];
+
+            if (right->oper == EcsQueryOperNot || right->id.value != left->id.value) {
+                continue;
+            }
+            if (left->access != EcsQueryAccessIn || right->access != EcsQueryAccessIn) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Each system goes in the wave right after the last earlier system of its
+// phase it conflicts with, so conflicting systems keep declaration order.
+static void ecs_pipeline_assign_waves(ecs_world_t *world, ecs_pipeline_system_t *systems, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        const ecs_query_t *query = &ECS_VEC_GET(ecs_query_cache_t, &world->queries, systems[i].query)->query;
+
+        systems[i].wave = 0;
+        for (uint32_t j = 0; j < i; j++) {
+            const ecs_query_t *other = &ECS_VEC_GET(ecs_query_cache_t, &world->queries, systems[j].query)->query;
+
+            if (systems[j].wave >= systems[i].wave && ecs_pipeline_conflicts(world, query, other)) {
+                systems[i].wave = systems[j].wave + 1;
+            }
+        }
+    }
+}
+
+// Kahn's algorithm over phases sorted by creation; among ready phases the
+// oldest goes first. Phases caught in a cycle are appended in creation order.
+static void ecs_pipeline_sort_phases(ecs_world_t *world, ecs_vec_t *phases, ecs_vec_t *order) {
+    uint32_t count = phases->count;
+    uint32_t *phase_data = phases->data;
+    bool *edges = calloc((size_t) count * count + 1, sizeof(bool)); // edges[before * count + after]
+    uint32_t *in_degree = calloc(count + 1, sizeof(uint32_t));
+    bool *placed = calloc(count + 1, sizeof(bool));
+
+    for (uint32_t i = 0; i < count; i++) {
+        ecs_entity_t phase = ecs_entity_manager_get_entity(&world->entity_manager, phase_data[i]);
+
+        iter_vec(ecs_entity_t, &ecs_world_get_entity_archetype(world, phase)->type->ids) {
+            bool depends = ecs_pipeline_is_pair_of(iter_value, ecs_id(EcsDependsOn));
+
+            if (!depends && !ecs_pipeline_is_pair_of(iter_value, ecs_id(EcsEnables))) {
+                continue;
+            }
+            uint32_t other = ecs_pipeline_phase_position(phases, iter_value.relation.target);
+            if (other == UINT32_MAX || other == i) {
+                continue;
+            }
+            uint32_t before = depends ? other : i;
+            uint32_t after = depends ? i : other;
+            if (!edges[before * count + after]) {
+                edges[before * count + after] = true;
+                in_degree[after]++;
+            }
+        }
+    }
+
+    for (uint32_t placed_count = 0; placed_count < count; placed_count++) {
+        uint32_t next = UINT32_MAX;
+
+        for (uint32_t i = 0; i < count && next == UINT32_MAX; i++) {
+            if (!placed[i] && in_degree[i] == 0) {
+                next = i;
+            }
+        }
+        if (next == UINT32_MAX) {
+            for (uint32_t i = 0; i < count && next == UINT32_MAX; i++) {
+                if (!placed[i]) {
+                    next = i;
+                }
+            }
+        }
+        placed[next] = true;
+        ecs_vec_push(order, &phase_data[next]);
+        for (uint32_t i = 0; i < count; i++) {
+            if (edges[next * count + i] && in_degree[i]) {
+                in_degree[i]--;
+            }
+        }
+    }
+    free(edges);
+    free(in_degree);
+    free(placed);
+}
+
+void ecs_pipeline_build(ecs_world_t *world) {
+    ecs_pipeline_t *pipeline = &world->pipeline;
+    ecs_vec_t systems = ecs_vec_create(sizeof(ecs_pipeline_system_t));
+    ecs_vec_t system_phases = ecs_vec_create(sizeof(uint32_t));
+    ecs_vec_t phases = ecs_vec_create(sizeof(uint32_t));
+    ecs_vec_t order = ecs_vec_create(sizeof(uint32_t));
+
+    ecs_iter_t it = ecs_query_iter(world, pipeline->phase_query);
+    while (ecs_iter_next(&it)) {
+        for (int i = 0; i < it.count; i++) {
+            ecs_vec_push(&phases, &ecs_it_entity(&it, i).index);
+        }
+    }
+
+    it = ecs_query_iter(world, pipeline->system_query);
+    while (ecs_iter_next(&it)) {
+        EcsSystem *system = ecs_field_at(&it, EcsSystem, 0);
+        EcsQueryId *query = ecs_field_at(&it, EcsQueryId, 1);
+        uint32_t phase = UINT32_MAX;
+
+        iter_vec(ecs_entity_t, &it.archetype_p->type->ids) {
+            if (ecs_pipeline_is_pair_of(iter_value, ecs_id(EcsPhase))) {
+                phase = iter_value.relation.target;
+                break;
+            }
+        }
+        if (phase == UINT32_MAX) {
+            continue;
+        }
+        if (ecs_pipeline_phase_position(&phases, phase) == UINT32_MAX) {
+            ecs_vec_push(&phases, &phase);
+        }
+        for (int i = 0; i < it.count; i++) {
+            ecs_vec_push(&systems, &(ecs_pipeline_system_t) {
+                .entity = ecs_it_entity(&it, i),
+                .func = system[i].func,
+                .query = query[i],
+                .order = system[i].order,
+            });
+            ecs_vec_push(&system_phases, &phase);
+        }
+    }
+
+    ecs_pipeline_sort_by_creation(world, &phases);
+    ecs_pipeline_sort_phases(world, &phases, &order);
+
+    pipeline->systems.count = 0;
+    pipeline->phase_ends.count = 0;
+    iter_vec(uint32_t, &order) {
+        uint32_t begin = pipeline->systems.count;
+
+        for (uint32_t s = 0; s < systems.count; s++) {
+            if (*ECS_VEC_GET(uint32_t, &system_phases, s) == iter_value) {
+                ecs_vec_push(&pipeline->systems, ECS_VEC_GET(ecs_pipeline_system_t, &systems, s));
+            }
+        }
+        uint32_t end = pipeline->systems.count;
+
+        if (end > begin) {
+            ecs_pipeline_system_t *phase_systems = ECS_VEC_GET(ecs_pipeline_system_t, &pipeline->systems, begin);
+
+            qsort(phase_systems, end - begin, sizeof(ecs_pipeline_system_t), ecs_pipeline_compare_system);
+            ecs_pipeline_assign_waves(world, phase_systems, end - begin);
+        }
+        ecs_vec_push(&pipeline->phase_ends, &end);
+    }
+
+    ecs_vec_free(&systems);
+    ecs_vec_free(&system_phases);
+    ecs_vec_free(&phases);
+    ecs_vec_free(&order);
+    pipeline->dirty = false;
+}
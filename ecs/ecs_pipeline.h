@@ -0,0 +1,44 @@
+#ifndef ECS_PIPELINE_H
+    #define ECS_PIPELINE_H
+    #include "datastructure/ecs_sparseset.h"
+    #include "datastructure/ecs_vec.h"
+    #include "ecs_query.h"
+    #include "ecs_types.h"
+    #include <stdbool.h>
+    #include <stdint.h>
+
+typedef struct {
+    ecs_entity_t entity;
+    ecs_iter_func func;
+    EcsQueryId query;
+    uint32_t order; // creation sequence of the system
+    uint32_t wave; // systems of a phase only share a wave if they don't conflict
+} ecs_pipeline_system_t;
+
+typedef struct {
+    ecs_entity_t entity; // tells a recycled index apart
+    uint32_t order; // creation sequence of the phase
+} ecs_pipeline_phase_t;
+
+// Every system of every phase, flattened in execution order. Phases are
+// entities tagged EcsPhase (or used as a system phase), ordered by their
+// (EcsDependsOn, P) and (EcsEnables, P) pairs, then by creation; systems keep
+// declaration order inside a phase.
+typedef struct {
+    ecs_vec_t systems; // ecs_pipeline_system_t
+    ecs_vec_t phase_ends; // uint32_t, one past the last system of each phase
+    EcsQueryId system_query;
+    EcsQueryId phase_query;
+    uint32_t system_count; // systems created so far, numbers the next one
+    ecs_sparseset_t phases; // <phase index, ecs_pipeline_phase_t>
+    uint32_t phase_count; // phases seen so far, numbers the next one
+    bool dirty;
+} ecs_pipeline_t;
+
+void ecs_pipeline_init(ecs_pipeline_t *pipeline);
+void ecs_pipeline_fini(ecs_pipeline_t *pipeline);
+void ecs_pipeline_build(ecs_world_t *world);
+void ecs_pipeline_invalidate(ecs_world_t *world);
+uint32_t ecs_pipeline_phase_order(ecs_world_t *world, ecs_entity_t phase);
+
+#endif
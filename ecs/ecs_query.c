@@ -2,88 +2,327 @@
 #include "ecs_archetype.h"
 #include "ecs_config.h"
 #include "ecs_sparseset.h"
+#include "ecs_task_deque.h"
 #include "ecs_types.h"
 #include "ecs_vec.h"
 #include "ecs_world.h"
 #include "dsl_types.h"
 #include "parser.h"
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
 
 typedef struct {} EcsQueryIdMap;
 
 ECS_COMPONENT_DEFINE(EcsQueryId);
 ECS_COMPONENT_DEFINE(EcsQueryIdMap);
 
-bool ecs_query_match_type(ecs_query_t *query, ecs_type_t *type) {
-    ecs_entity_t *entities = type->data;
-    uint32_t tlen = type->count;
+void ecs_query_signature_init(ecs_query_signature_t *signature, const ecs_query_t *query) {
+    *signature = (ecs_query_signature_t) {0};
 
-    for (uint32_t i = 0; query->terms[i].id.value; i++) {
-        ecs_query_term_t term = query->terms[i];
-        bool matched = false;
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT && query->terms[i].id.value; i++) {
+        const ecs_query_term_t *term = &query->terms[i];
 
-        if (term.flags & EcsQueryFlagSingleton) {
+        if (term->flags & (EcsQueryFlagSingleton | EcsQueryFlagCascade | EcsQueryFlagSparse)) {
             continue;
         }
+        if (term->oper == EcsQueryOperEqual && ecs_is_wildcard_pair(term->id)) {
+            signature->wildcard_ids[signature->wildcard_count++] = term->id.value;
+        } else if (term->oper == EcsQueryOperEqual) {
+            signature->and_ids[signature->and_count++] = term->id.value;
+            ecs_type_bloom_add(&signature->and_bloom, term->id.value);
+        } else if (term->oper == EcsQueryOperNot) {
+            signature->not_ids[signature->not_count++] = term->id.value;
+        }
+    }
 
-        for (uint32_t j = 0; j < tlen; j++) {
-            if (term.id.value == entities[j].value) {
-                matched = true;
-                break;
-            }
+    // insertion sort, at most 8 ids
+    for (uint32_t i = 1; i < signature->and_count; i++) {
+        uint64_t id = signature->and_ids[i];
+        uint32_t j = i;
+        for (; j > 0 && signature->and_ids[j - 1] > id; j--) {
+            signature->and_ids[j] = signature->and_ids[j - 1];
+        }
+        signature->and_ids[j] = id;
+    }
+}
+
+// Advances `*cursor` through the sorted `ids` to the block that may hold
+// `id`, then compares that block four ids at a time.
+ECS_INLINE
+bool ecs_type_seek(const uint64_t *ids, uint32_t count, uint32_t *cursor, uint64_t id) {
+    uint32_t i = *cursor;
+
+    while (i + 4 <= count && ids[i + 3] < id) {
+        i += 4;
+    }
+    *cursor = i;
+
+    if (i + 4 <= count) {
+#if defined(__AVX2__)
+        __m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (ids + i)), _mm256_set1_epi64x(id));
+        return _mm256_movemask_epi8(eq) != 0;
+#elif defined(__SSE2__)
+        // SSE2 has no 64-bit compare: a lane is equal when both of its halves are
+        __m128i key = _mm_set1_epi64x(id);
+        __m128i lo = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (ids + i)), key);
+        __m128i hi = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (ids + i + 2)), key);
+        lo = _mm_and_si128(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+        hi = _mm_and_si128(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_movemask_epi8(_mm_or_si128(lo, hi)) != 0;
+#endif
+    }
+    for (; i < count && ids[i] <= id; i++) {
+        if (ids[i] == id) {
+            *cursor = i;
+            return true;
         }
+    }
+    *cursor = i;
+    return false;
+}
 
-        if (term.oper == EcsQueryOperEqual && !matched) {
+bool ecs_query_signature_match(const ecs_query_signature_t *signature, const ecs_type_info_t *type) {
+    if (!ecs_type_bloom_may_contain(type->bloom, signature->and_bloom)) {
+        return false;
+    }
+
+    const uint64_t *ids = type->ids.data;
+    uint32_t count = type->ids.count;
+    uint32_t cursor = 0;
+
+    for (uint32_t i = 0; i < signature->and_count; i++) {
+        if (!ecs_type_seek(ids, count, &cursor, signature->and_ids[i])) {
             return false;
         }
-        if (term.oper == EcsQueryOperNot && matched) {
+    }
+    for (uint32_t i = 0; i < signature->wildcard_count; i++) {
+        if (!ecs_query_term_match(type, (ecs_entity_t) { .value = signature->wildcard_ids[i] }).value) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < signature->not_count; i++) {
+        if (ecs_query_term_match(type, (ecs_entity_t) { .value = signature->not_ids[i] }).value) {
             return false;
         }
     }
-
     return true;
 }
 
-ECS_INLINE
-ecs_entity_t get_select_query_select(ecs_query_t *query) {
-    for (int i = 0; query->terms[i].id.value; i++) {
-        if (query->terms[i].oper == EcsQueryOperEqual) {
-            return query->terms[i].id;
-        }
+// The id of `type` a term on `id` resolves to, zero if there is none.
+ecs_entity_t ecs_query_term_match(const ecs_type_info_t *type, ecs_entity_t id) {
+    if (ecs_is_wildcard_pair(id)) {
+        return ecs_type_info_find_relation(type, id.relation.relation);
     }
-    return ECS_NULL;
+    return ecs_type_info_has(type, id) ? id : (ecs_entity_t) { .value = 0 };
+}
+
+bool ecs_query_match_type(ecs_query_t *query, const ecs_type_info_t *type) {
+    ecs_query_signature_t signature;
+
+    ecs_query_signature_init(&signature, query);
+    return ecs_query_signature_match(&signature, type);
 }
 
-static void ecs_query_update_matches(ecs_world_t *world, ecs_query_cache_t *cache) {
+// Only archetypes holding the AND id with the fewest archetypes can match;
+// (R, *) ids list the tables with any pair of R.
+static void ecs_query_match_signature(ecs_world_t *world, const ecs_query_signature_t *signature, ecs_vec_t *matches) {
     ecs_archetype_t *archetypes = world->archetypes.data;
-    uint32_t len = world->archetypes.count;
-
-    ecs_entity_t select = get_select_query_select(&cache->query);
-    if (select.value) {
-        ecs_vec_t *select_archetypes = ecs_sparseset_get(&world->component_archetypes, select.value);
-        if (select_archetypes) {
-            ecs_archetype_id_t *select_ids = select_archetypes->data;
-            for (uint32_t i = 0; i < select_archetypes->count; i++) {
-                if (ecs_query_match_type(&cache->query, &archetypes[select_ids[i]].type)) {
-                    ecs_vec_push(&cache->archetypes, &select_ids[i]);
-                }
+    ecs_vec_t *select = NULL;
+
+    for (uint32_t i = 0; i < signature->and_count + signature->wildcard_count; i++) {
+        uint64_t id = i < signature->and_count
+            ? signature->and_ids[i]
+            : signature->wildcard_ids[i - signature->and_count];
+        ecs_vec_t *candidates = ecs_sparseset_get(&world->component_archetypes, id);
+        if (!candidates) {
+            return;
+        }
+        if (!select || candidates->count < select->count) {
+            select = candidates;
+        }
+    }
+
+    if (select) {
+        ecs_archetype_id_t *select_ids = select->data;
+        for (uint32_t i = 0; i < select->count; i++) {
+            if (ecs_query_signature_match(signature, archetypes[select_ids[i]].type)) {
+                ecs_vec_push(matches, &select_ids[i]);
             }
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < world->archetypes.count; i++) {
+        if (ecs_archetype_is_alive(&archetypes[i]) && ecs_query_signature_match(signature, archetypes[i].type)) {
+            ecs_vec_push(matches, &i);
+        }
+    }
+}
+
+// Sparse components live outside of tables: their terms are left out of the
+// signature and checked per entity while iterating. Tags have no column, so
+// their terms never resolve one.
+static void ecs_query_flag_storage(ecs_world_t *world, ecs_query_t *query) {
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT && query->terms[i].id.value; i++) {
+        if (ecs_world_sparse_storage(world, query->terms[i].id)) {
+            query->terms[i].flags |= EcsQueryFlagSparse;
+        }
+        if (!ecs_component_storage_get_component_size(&world->component_storage, query->terms[i].id)) {
+            query->terms[i].flags |= EcsQueryFlagTag;
+        }
+    }
+}
+
+bool ecs_query_has_sparse_terms(ecs_world_t *world, const ecs_query_t *query) {
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT && query->terms[i].id.value; i++) {
+        if (ecs_world_sparse_storage(world, query->terms[i].id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tables that may hold matching rows; sparse terms are not checked.
+void ecs_query_match_archetypes(ecs_world_t *world, ecs_query_t *query, ecs_vec_t *matches) {
+    ecs_query_signature_t signature;
+    ecs_query_t flagged = *query;
+
+    ecs_query_flag_storage(world, &flagged);
+    ecs_query_signature_init(&signature, &flagged);
+    ecs_query_match_signature(world, &signature, matches);
+}
+
+static uint32_t ecs_query_cache_push(ecs_query_cache_t *cache, ecs_archetype_id_t archetype_id, ecs_archetype_t *archetype) {
+    ecs_query_match_t *match = ecs_vec_add(&cache->archetypes);
+
+    match->archetype = archetype_id;
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT; i++) {
+        ecs_entity_t id = cache->query.terms[i].id;
+
+        match->ids[i] = ecs_is_wildcard_pair(id) ? ecs_query_term_match(archetype->type, id) : id;
+        ecs_column_t *column = match->ids[i].value && !(cache->query.terms[i].flags & EcsQueryFlagTag)
+            ? ecs_sparseset_get(&archetype->rows, match->ids[i].value)
+            : NULL;
+        match->column_offsets[i] = column ? column->offset : ECS_QUERY_NO_COLUMN;
+    }
+    return cache->archetypes.count - 1;
+}
+
+static void ecs_query_ref_update(ecs_world_t *world, ecs_archetype_id_t archetype_id, EcsQueryId query, uint32_t index) {
+    ecs_vec_t *refs = &ecs_world_get_archetype(world, archetype_id)->query_refs;
+
+    iter_vec(ecs_archetype_query_ref_t, refs) {
+        if (iter_value.query == query) {
+            iter_value.index = index;
             return;
         }
     }
-    for (uint32_t i = 0; i < len; i++) {
-        if (ecs_query_match_type(&cache->query, &archetypes[i].type)) {
-            ecs_vec_push(&cache->archetypes, &i);
+}
+
+static void ecs_query_cache_swap(ecs_world_t *world, EcsQueryId query, uint32_t a, uint32_t b) {
+    ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, query);
+    ecs_query_match_t *matches = cache->archetypes.data;
+    ecs_query_match_t tmp = matches[a];
+
+    if (a == b) {
+        return;
+    }
+    matches[a] = matches[b];
+    matches[b] = tmp;
+    ecs_query_ref_update(world, matches[a].archetype, query, a);
+    ecs_query_ref_update(world, matches[b].archetype, query, b);
+}
+
+void ecs_query_cache_add(ecs_world_t *world, EcsQueryId query, ecs_archetype_id_t archetype_id) {
+    ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, query);
+    ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+    ecs_archetype_query_ref_t ref = {
+        .query = query,
+        .index = ecs_query_cache_push(cache, archetype_id, archetype)
+    };
+
+    ecs_vec_push(&archetype->query_refs, &ref);
+    iter_vec(ecs_archetype_observer_ref_t, &cache->observers) {
+        ecs_vec_push(&archetype->observer_refs, &iter_value);
+    }
+    if (cache->cascade) {
+        cache->active_count = cache->archetypes.count;
+        cache->cascade_dirty = true;
+    } else if (archetype->entities.count) {
+        ecs_query_cache_swap(world, query, ref.index, cache->active_count++);
+    }
+}
+
+// Called when an archetype gets its first row or loses its last one.
+void ecs_query_archetype_set_active(ecs_world_t *world, ecs_archetype_id_t archetype_id, bool active) {
+    ecs_vec_t *refs = &ecs_world_get_archetype(world, archetype_id)->query_refs;
+
+    for (uint32_t i = 0; i < refs->count; i++) {
+        ecs_archetype_query_ref_t ref = *ECS_VEC_GET(ecs_archetype_query_ref_t, refs, i);
+        ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, ref.query);
+
+        if (cache->cascade) {
+            continue;
+        }
+        if (active && ref.index >= cache->active_count) {
+            ecs_query_cache_swap(world, ref.query, ref.index, cache->active_count++);
+        } else if (!active && ref.index < cache->active_count) {
+            ecs_query_cache_swap(world, ref.query, ref.index, --cache->active_count);
         }
     }
 }
 
+// Drops an empty archetype from every cache it belongs to.
+void ecs_query_archetype_remove(ecs_world_t *world, ecs_archetype_id_t archetype_id) {
+    ecs_vec_t *refs = &ecs_world_get_archetype(world, archetype_id)->query_refs;
+
+    for (uint32_t i = 0; i < refs->count; i++) {
+        ecs_archetype_query_ref_t ref = *ECS_VEC_GET(ecs_archetype_query_ref_t, refs, i);
+        ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, ref.query);
+
+        ecs_query_cache_swap(world, ref.query, ref.index, cache->archetypes.count - 1);
+        ecs_vec_remove_last(&cache->archetypes);
+        if (cache->cascade) {
+            cache->active_count = cache->archetypes.count;
+            cache->cascade_dirty = true;
+        }
+    }
+    refs->count = 0;
+    ecs_world_get_archetype(world, archetype_id)->observer_refs.count = 0;
+}
+
+static const ecs_query_access_t ecs_query_access_from_dsl[] = {
+    [ECS_DSL_ACCESS_DEFAULT] = EcsQueryAccessDefault,
+    [ECS_DSL_ACCESS_IN] = EcsQueryAccessIn,
+    [ECS_DSL_ACCESS_OUT] = EcsQueryAccessOut,
+    [ECS_DSL_ACCESS_INOUT] = EcsQueryAccessInOut,
+};
+
 static ecs_query_term_t ecs_query_term_from_dsl(ecs_world_t *world, ecs_dsl_term_t term) {
-    ecs_query_term_t result = {0};
+    ecs_query_term_t result = {
+        .access = ecs_query_access_from_dsl[term.access],
+        .flags = term.changed ? EcsQueryFlagChanged : 0,
+    };
 
+    if (term.cascade) {
+        ecs_entity_t relation = ecs_strmap_get(&world->entity_map, term.id.first);
+
+        if (!relation.value) {
+            return (ecs_query_term_t) {0};
+        }
+        result.id = ecs_make_pair(relation, ecs_id(EcsWildcard));
+        result.oper = EcsQueryOperEqual;
+        result.flags |= EcsQueryFlagCascade;
+        result.access = EcsQueryAccessIn;
+        return result;
+    }
     if (term.id.is_pair) {
         result.id = ecs_make_pair(
             ecs_strmap_get(&world->entity_map, term.id.first),
@@ -113,7 +352,7 @@ ecs_query_t *ecs_query_from_str(ecs_world_t *world, const char *str) {
     ecs_dsl_parser_init(&parser, str);
     ecs_dsl_query_t *dsl_query = ecs_dsl_parser_parse(&parser);
 
-    ecs_query_t *query = malloc(sizeof(ecs_query_t));
+    ecs_query_t *query = calloc(1, sizeof(ecs_query_t));
 
     for (uint32_t i = 0; i < dsl_query->count && i < 8; i++) {
         query->terms[i] = ecs_query_term_from_dsl(world, dsl_query->terms[i]);
@@ -128,56 +367,462 @@ ecs_query_t *ecs_query_from_str(ecs_world_t *world, const char *str) {
 }
 
 EcsQueryId ecs_query_register(ecs_world_t *world, ecs_query_t *query) {
+    EcsQueryId query_id = world->queries.count;
     ecs_query_cache_t cache = {
-        .archetypes = ecs_vec_create(sizeof(ecs_archetype_id_t)),
-        .query = *query
+        .archetypes = ecs_vec_create(sizeof(ecs_query_match_t)),
+        .active_count = 0,
+        .query = *query,
+        .observers = (ecs_vec_t) { .size = sizeof(ecs_archetype_observer_ref_t) },
     };
+    ecs_vec_t matches = ecs_vec_create(sizeof(ecs_archetype_id_t));
 
-    ecs_query_update_matches(world, &cache);
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT && query->terms[i].id.value; i++) {
+        if (query->terms[i].flags & EcsQueryFlagCascade) {
+            cache.cascade = query->terms[i].id.relation.relation;
+            ecs_sparseset_ensure(&world->cascade_versions, cache.cascade);
+        }
+    }
+    ecs_query_flag_storage(world, &cache.query);
+    ecs_query_signature_init(&cache.signature, &cache.query);
     ecs_vec_push(&world->queries, &cache);
-    return world->queries.count - 1;
+    ecs_query_match_signature(world, &cache.signature, &matches);
+    iter_vec(ecs_archetype_id_t, &matches) {
+        ecs_query_cache_add(world, query_id, iter_value);
+    }
+    ecs_vec_free(&matches);
+    return query_id;
 }
 
-ecs_iter_t ecs_query(ecs_world_t *world, ecs_query_t *query) {
-    static ecs_query_cache_t cache;
+static void ecs_iter_init_sparse(ecs_iter_t *it) {
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT && it->query->terms[i].id.value; i++) {
+        const ecs_query_term_t *term = &it->query->terms[i];
 
-    cache.archetypes = ecs_vec_create(sizeof(ecs_archetype_id_t));
-    cache.query = *query;
+        if (!(term->flags & EcsQueryFlagSparse)) {
+            continue;
+        }
+        ecs_component_record_t *component_record = ecs_component_get_record(it->world, term->id);
+        it->sparse[i] = component_record->sparse;
+        it->sparse_terms |= 1 << i;
+        if (term->oper != EcsQueryOperNot && component_record->size) {
+            it->sparse_values |= 1 << i;
+        }
+    }
+}
 
-    ecs_query_update_matches(world, &cache);
-    return (ecs_iter_t) {
+static ecs_iter_t ecs_iter_from_cache(ecs_world_t *world, ecs_query_cache_t *cache) {
+    ecs_iter_t it = {
         .world = world,
-        .archetypes = &cache.archetypes,
+        .query = &cache->query,
+        .archetypes = &cache->archetypes,
+        .active_count = &cache->active_count,
         .count = 0,
-        .current_archetype = -1
+        .current_archetype = -1,
+        .last_run = cache->last_run,
     };
+
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT && cache->query.terms[i].id.value; i++) {
+        const ecs_query_term_t *term = &cache->query.terms[i];
+
+        if (term->oper != EcsQueryOperNot && term->access != EcsQueryAccessIn && !(term->flags & EcsQueryFlagTag)) {
+            it.write_terms |= 1 << i;
+        }
+        if (term->flags & EcsQueryFlagChanged) {
+            it.changed_terms |= 1 << i;
+        }
+    }
+    ecs_iter_init_sparse(&it);
+    return it;
+}
+
+ecs_iter_t ecs_query(ecs_world_t *world, ecs_query_t *query) {
+    static ecs_query_cache_t cache;
+
+    cache.archetypes = ecs_vec_create(sizeof(ecs_query_match_t));
+    cache.query = *query;
+    cache.last_run = 0;
+    ecs_query_flag_storage(world, &cache.query);
+    ecs_query_signature_init(&cache.signature, &cache.query);
+
+    // one-shot: only snapshot the tables that currently have rows
+    ecs_vec_t matches = ecs_vec_create(sizeof(ecs_archetype_id_t));
+    ecs_query_match_signature(world, &cache.signature, &matches);
+    iter_vec(ecs_archetype_id_t, &matches) {
+        ecs_archetype_t *archetype = ecs_world_get_archetype(world, iter_value);
+        if (archetype->entities.count) {
+            ecs_query_cache_push(&cache, iter_value, archetype);
+        }
+    }
+    ecs_vec_free(&matches);
+    cache.active_count = cache.archetypes.count;
+
+    return ecs_iter_from_cache(world, &cache);
+}
+
+// Depth of a table along `relation`: its parent's depth plus one, 0 for
+// tables without the relation. Chains longer than the world (cycles) stop.
+static uint32_t ecs_query_table_depth(ecs_world_t *world, const ecs_archetype_t *archetype, uint32_t relation) {
+    uint32_t depth = 0;
+    ecs_entity_t pair = ecs_type_info_find_relation(archetype->type, relation);
+
+    while (pair.value && depth < world->archetypes.count) {
+        ecs_entity_record_t *record = ecs_world_get_record_by_index(world, pair.relation.target);
+
+        depth++;
+        pair = ecs_type_info_find_relation(ecs_world_get_archetype(world, record->archetype_id)->type, relation);
+    }
+    return depth;
+}
+
+typedef struct {
+    uint32_t depth;
+    ecs_query_match_t match;
+} ecs_query_depth_match_t;
+
+static int ecs_query_compare_depth(const void *a, const void *b) {
+    const ecs_query_depth_match_t *left = a;
+    const ecs_query_depth_match_t *right = b;
+
+    if (left->depth != right->depth) {
+        return left->depth < right->depth ? -1 : 1;
+    }
+    return (left->match.archetype > right->match.archetype) - (left->match.archetype < right->match.archetype);
 }
 
+// Re-buckets the tables of a cascading cache, only after tables came or went
+// or some entity gained or lost a pair of the cascade relation.
+static void ecs_query_cache_sort_cascade(ecs_world_t *world, EcsQueryId query, ecs_query_cache_t *cache) {
+    uint32_t count = cache->archetypes.count;
+    ecs_query_match_t *matches = cache->archetypes.data;
+    ecs_query_depth_match_t *sorted = malloc((count + 1) * sizeof(ecs_query_depth_match_t));
+
+    for (uint32_t i = 0; i < count; i++) {
+        sorted[i].depth = ecs_query_table_depth(world, ecs_world_get_archetype(world, matches[i].archetype), cache->cascade);
+        sorted[i].match = matches[i];
+    }
+    qsort(sorted, count, sizeof(ecs_query_depth_match_t), ecs_query_compare_depth);
+    for (uint32_t i = 0; i < count; i++) {
+        matches[i] = sorted[i].match;
+        ecs_query_ref_update(world, matches[i].archetype, query, i);
+    }
+    free(sorted);
+    cache->cascade_version = *(uint32_t *) ecs_sparseset_get(&world->cascade_versions, cache->cascade);
+    cache->cascade_dirty = false;
+}
+
+// Changed() terms see the writes made since the system owning the query last
+// ran. Iterating is read-only: neither the cache nor the world tick move.
 ecs_iter_t ecs_query_iter(ecs_world_t *world, EcsQueryId query) {
-    ecs_vec_t *archetypes = &ECS_VEC_GET(ecs_query_cache_t, &world->queries, query)->archetypes;
+    ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, query);
 
-    return (ecs_iter_t) {
-        .world = world,
-        .archetypes = archetypes,
-        .count = 0,
-        .current_archetype = -1
-    };
+    if (cache->cascade && (cache->cascade_dirty
+        || cache->cascade_version != *(uint32_t *) ecs_sparseset_get(&world->cascade_versions, cache->cascade))) {
+        ecs_query_cache_sort_cascade(world, query, cache);
+    }
+    return ecs_iter_from_cache(world, cache);
 }
 
-bool ecs_iter_next(ecs_iter_t *it) {
-    it->current_archetype += 1;
+// Same as ecs_query_iter, but Changed() terms see the writes made since the
+// previous call with the same caller-owned `cursor` (every write, for a
+// zeroed one). Inside a system, the system's own tick is the boundary.
+ecs_iter_t ecs_query_iter_since(ecs_world_t *world, EcsQueryId query, uint32_t *cursor) {
+    ecs_command_buffer_t *system_stage = ecs_defer_thread_stage();
+    ecs_iter_t it = ecs_query_iter(world, query);
 
-    if (it->current_archetype >= (int) it->archetypes->count) {
-        return false;
+    it.last_run = *cursor;
+    if (system_stage) {
+        *cursor = system_stage->tick;
+    } else {
+        *cursor = ecs_world_write_tick(world);
+        world->tick_seen = true;
+    }
+    return it;
+}
+
+static bool ecs_iter_table_changed(const ecs_iter_t *it) {
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT; i++) {
+        if (!(it->changed_terms & (1 << i))) {
+            continue;
+        }
+        ecs_column_t *column = ecs_sparseset_get(&it->archetype_p->rows, it->ids[i].value);
+        if (column && (int32_t) (column->change_tick - it->last_run) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void ecs_iter_stamp_writes(const ecs_iter_t *it, uint32_t tick) {
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT; i++) {
+        if (!(it->write_terms & (1 << i))) {
+            continue;
+        }
+        ecs_column_t *column = ecs_sparseset_get(&it->archetype_p->rows, it->ids[i].value);
+        if (column) {
+            column->change_tick = tick;
+        }
+    }
+}
+
+static void ecs_iter_set_chunk(ecs_iter_t *it, const ecs_query_match_t *match, uint32_t chunk) {
+    ecs_archetype_t *archetype = it->archetype_p;
+    char *data = chunk < archetype->chunks.count ? *ECS_VEC_GET(char *, &archetype->chunks, chunk) : NULL;
+
+    it->current_chunk = chunk;
+    it->ids = match->ids;
+    it->offset = chunk * archetype->chunk_capacity;
+    it->count = ecs_archetype_chunk_count(archetype) ? ecs_archetype_chunk_rows(archetype, chunk) : 0;
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT; i++) {
+        uint32_t offset = match->column_offsets[i];
+        it->columns[i] = data && offset != ECS_QUERY_NO_COLUMN ? data + offset : NULL;
+    }
+}
+
+static bool ecs_iter_next_chunk(ecs_iter_t *it) {
+    ecs_query_match_t *match;
+
+    if (it->current_archetype >= 0) {
+        match = ECS_VEC_GET(ecs_query_match_t, it->archetypes, it->current_archetype);
+        it->archetype_p = ecs_world_get_archetype(it->world, match->archetype);
+
+        if ((uint32_t) it->current_chunk + 1 < ecs_archetype_chunk_count(it->archetype_p)) {
+            ecs_iter_set_chunk(it, match, it->current_chunk + 1);
+            return true;
+        }
+    }
+    do {
+        it->current_archetype += 1;
+        if (it->current_archetype >= (int) *it->active_count) {
+            return false;
+        }
+        match = ECS_VEC_GET(ecs_query_match_t, it->archetypes, it->current_archetype);
+        it->archetype_p = ecs_world_get_archetype(it->world, match->archetype);
+        it->ids = match->ids;
+    } while (!it->archetype_p->entities.count || (it->changed_terms && !ecs_iter_table_changed(it)));
+
+    if (it->tick) {
+        ecs_iter_stamp_writes(it, it->tick);
+    }
+    ecs_iter_set_chunk(it, match, 0);
+    return true;
+}
+
+static bool ecs_iter_sparse_row_matches(const ecs_iter_t *it, uint32_t row) {
+    uint32_t index = ECS_VEC_GET(ecs_entity_t, &it->archetype_p->entities, row)->index;
+
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT; i++) {
+        if ((it->sparse_terms & (1 << i))
+            && ecs_sparseset_exists(it->sparse[i], index) == (it->query->terms[i].oper == EcsQueryOperNot)) {
+            return false;
+        }
     }
+    return true;
+}
 
-    ecs_archetype_id_t archetype_id = *ECS_VEC_GET(ecs_archetype_id_t, it->archetypes, it->current_archetype);
-    it->archetype_p = ecs_world_get_archetype(it->world, archetype_id);
-    it->count = it->archetype_p->entities.count;
+// Next run of rows in [sparse_row, sparse_end) that passes every sparse
+// term. Table columns point at the run's first row, sparse ones at that
+// row's value, which is why runs stop after one row when a sparse term
+// holds a value.
+static bool ecs_iter_next_run(ecs_iter_t *it) {
+    ecs_archetype_t *archetype = it->archetype_p;
+    uint32_t row = it->sparse_row;
 
+    while (row < it->sparse_end && !ecs_iter_sparse_row_matches(it, row)) {
+        row++;
+    }
+    if (row >= it->sparse_end) {
+        it->sparse_row = row;
+        return false;
+    }
+    uint32_t end = row + 1;
+    while (!it->sparse_values && end < it->sparse_end && ecs_iter_sparse_row_matches(it, end)) {
+        end++;
+    }
+    it->sparse_row = end;
+    it->offset = row;
+    it->count = end - row;
+
+    ecs_entity_t entity = *ECS_VEC_GET(ecs_entity_t, &archetype->entities, row);
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT; i++) {
+        if (it->sparse_terms & (1 << i)) {
+            it->columns[i] = ecs_sparseset_get(it->sparse[i], entity.index);
+            continue;
+        }
+        ecs_column_t *column = it->ids[i].value ? ecs_sparseset_get(&archetype->rows, it->ids[i].value) : NULL;
+        it->columns[i] = column ? ecs_archetype_column_row(archetype, column, row) : NULL;
+    }
     return true;
 }
 
+// Yields one chunk at a time: it->count is the number of rows in the current
+// chunk and ecs_field() points at that chunk's columns. Empty tables are
+// never visited, nor are tables none of the Changed() terms were written in.
+// With sparse terms, chunks are further cut into runs of matching rows.
+bool ecs_iter_next(ecs_iter_t *it) {
+    if (ECS_LIKELY(!it->sparse_terms)) {
+        return ecs_iter_next_chunk(it);
+    }
+    while (!ecs_iter_next_run(it)) {
+        if (!ecs_iter_next_chunk(it)) {
+            return false;
+        }
+        it->sparse_row = it->offset;
+        it->sparse_end = it->offset + it->count;
+    }
+    return true;
+}
+
+typedef struct {
+    uint32_t match; // index in the cache archetypes
+    uint32_t chunk;
+    uint32_t row; // first row, relative to the chunk
+    uint32_t count;
+} ecs_iter_range_t;
+
+typedef struct {
+    ecs_world_t *world;
+    ecs_query_cache_t *cache;
+    ecs_iter_func func;
+    ecs_iter_range_t *ranges;
+    ecs_task_deque_t *deques;
+    ecs_command_buffer_t *stages;
+    uint32_t worker_count;
+    uint32_t term_sizes[ECS_QUERY_TERM_COUNT];
+} ecs_iter_parallel_t;
+
+static void ecs_iter_parallel_run_range(ecs_iter_parallel_t *ctx, const ecs_iter_range_t *range) {
+    const ecs_query_match_t *match = ECS_VEC_GET(ecs_query_match_t, &ctx->cache->archetypes, range->match);
+    ecs_archetype_t *archetype = ecs_world_get_archetype(ctx->world, match->archetype);
+    // tag-only tables have no chunks at all
+    char *data = archetype->chunk_size ? *ECS_VEC_GET(char *, &archetype->chunks, range->chunk) : NULL;
+    ecs_iter_t it = {
+        .world = ctx->world,
+        .query = &ctx->cache->query,
+        .archetypes = &ctx->cache->archetypes,
+        .active_count = &ctx->cache->active_count,
+        .archetype_p = archetype,
+        .ids = match->ids,
+        .current_archetype = range->match,
+        .current_chunk = range->chunk,
+        .offset = range->chunk * archetype->chunk_capacity + range->row,
+        .count = range->count,
+    };
+
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT; i++) {
+        uint32_t offset = match->column_offsets[i];
+        it.columns[i] = data && offset != ECS_QUERY_NO_COLUMN
+            ? data + offset + (size_t) range->row * ctx->term_sizes[i]
+            : NULL;
+    }
+    ecs_iter_init_sparse(&it);
+    if (!it.sparse_terms) {
+        ctx->func(&it);
+        return;
+    }
+    it.sparse_row = it.offset;
+    it.sparse_end = it.offset + it.count;
+    while (ecs_iter_next_run(&it)) {
+        ctx->func(&it);
+    }
+}
+
+static void ecs_iter_parallel_job(void *arg, uint32_t worker) {
+    ecs_iter_parallel_t *ctx = arg;
+    ecs_command_buffer_t *previous = ecs_defer_set_stage(&ctx->stages[worker]);
+    uint32_t range;
+
+    for (;;) {
+        bool found = ecs_task_deque_pop(&ctx->deques[worker], &range);
+
+        for (uint32_t i = 1; !found && i < ctx->worker_count; i++) {
+            found = ecs_task_deque_steal(&ctx->deques[(worker + i) % ctx->worker_count], &range);
+        }
+        if (!found) {
+            break;
+        }
+        ecs_iter_parallel_run_range(ctx, &ctx->ranges[range]);
+    }
+    ecs_defer_set_stage(previous);
+}
+
+// Runs `func` over the populated tables of `query`, split into ranges of at
+// most `grain` rows (0 for whole chunks) spread over the worker pool. Each
+// worker starts on a contiguous share of the ranges and steals from the
+// others once it runs dry. Structural changes are deferred and merged into
+// the caller's stage afterwards; Changed() terms behave as in ecs_query_iter.
+// Called from a system, other systems of its wave may be running: the query
+// cache and the world's defer depth are left alone, the changes go to the
+// system's stage and the writes carry the system's tick.
+void ecs_iter_parallel(ecs_world_t *world, EcsQueryId query, ecs_iter_func func, uint32_t grain) {
+    ecs_iter_parallel_t ctx = {
+        .world = world,
+        .cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, query),
+        .func = func,
+        .worker_count = ecs_worker_pool_size(&world->workers),
+    };
+    ecs_vec_t ranges = ecs_vec_create(sizeof(ecs_iter_range_t));
+    ecs_command_buffer_t *system_stage = ecs_defer_thread_stage();
+    uint32_t tick = system_stage ? system_stage->tick : ecs_world_write_tick(world);
+    ecs_iter_t filter = system_stage ? ecs_iter_from_cache(world, ctx.cache) : ecs_query_iter(world, query);
+
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT && ctx.cache->query.terms[i].id.value; i++) {
+        ctx.term_sizes[i] = ecs_component_storage_get_component_size(
+            &world->component_storage, ctx.cache->query.terms[i].id);
+    }
+    for (uint32_t m = 0; m < ctx.cache->active_count; m++) {
+        const ecs_query_match_t *match = ECS_VEC_GET(ecs_query_match_t, &ctx.cache->archetypes, m);
+        ecs_archetype_t *archetype = ecs_world_get_archetype(world, match->archetype);
+        uint32_t step = grain ? grain : archetype->chunk_capacity;
+
+        filter.archetype_p = archetype;
+        filter.ids = match->ids;
+        if (!archetype->entities.count || (filter.changed_terms && !ecs_iter_table_changed(&filter))) {
+            continue;
+        }
+        ecs_iter_stamp_writes(&filter, tick);
+
+        for (uint32_t chunk = 0; chunk < ecs_archetype_chunk_count(archetype); chunk++) {
+            uint32_t rows = ecs_archetype_chunk_rows(archetype, chunk);
+
+            for (uint32_t row = 0; row < rows; row += step) {
+                ecs_vec_push(&ranges, &(ecs_iter_range_t) {
+                    .match = m,
+                    .chunk = chunk,
+                    .row = row,
+                    .count = rows - row < step ? rows - row : step,
+                });
+            }
+        }
+    }
+
+    ctx.ranges = ranges.data;
+    ctx.deques = aligned_alloc(_Alignof(ecs_task_deque_t), ctx.worker_count * sizeof(ecs_task_deque_t));
+    ctx.stages = malloc(ctx.worker_count * sizeof(ecs_command_buffer_t));
+    for (uint32_t w = 0; w < ctx.worker_count; w++) {
+        ecs_task_deque_init(&ctx.deques[w],
+            (uint64_t) ranges.count * w / ctx.worker_count,
+            (uint64_t) ranges.count * (w + 1) / ctx.worker_count);
+        ecs_command_buffer_init(&ctx.stages[w]);
+        ctx.stages[w].tick = tick;
+    }
+
+    // a system already runs deferred, under its phase
+    if (!system_stage) {
+        ecs_defer_begin(world);
+    }
+    ecs_worker_pool_run(&world->workers, ecs_iter_parallel_job, &ctx);
+    for (uint32_t w = 0; w < ctx.worker_count; w++) {
+        ecs_command_buffer_append(ecs_defer_stage(world), &ctx.stages[w]);
+        ecs_command_buffer_fini(&ctx.stages[w]);
+    }
+    if (!system_stage) {
+        ecs_defer_end(world);
+    }
+
+    free(ctx.stages);
+    free(ctx.deques);
+    ecs_vec_free(&ranges);
+}
+
 void EcsQueryModule(ecs_world_t *world) {
     ECS_REGISTER_COMPONENT(world, EcsQueryId);
     ECS_REGISTER_COMPONENT(world, EcsQueryIdMap);
@@ -7,8 +7,13 @@
 #include <stdint.h>
 
 #define query(...) ((ecs_query_t) __VA_ARGS__)
-#define ecs_field(it, component) ((component *) ((ecs_vec_t *) ecs_sparseset_get(&(it)->archetype_p->rows, ecs_id(component).value))->data)
-#define ecs_it_entity(it, index) *ECS_VEC_GET(ecs_entity_t, &(it)->archetype_p->entities, index)
+// Tags have no column to point at, so ecs_field() on one does not compile.
+#define ecs_assert_not_tag(component) \
+    ((void) sizeof(struct { _Static_assert(sizeof(component) > 0, #component " is a tag, it has no field"); char unused; }))
+#define ecs_field(it, component) (ecs_assert_not_tag(component), (component *) ecs_iter_column(it, ecs_id(component)))
+#define ecs_field_at(it, component, term) ((component *) (it)->columns[term])
+#define ecs_field_id(it, term) ((it)->ids[term])
+#define ecs_it_entity(it, index) (*ECS_VEC_GET(ecs_entity_t, &(it)->archetype_p->entities, (it)->offset + (index)))
 
 typedef uint32_t EcsQueryId;
 typedef enum {
@@ -18,39 +23,129 @@ typedef enum {
     EcsQueryOperOr
 } ecs_query_term_oper_t;
 
+// How a system touches a term's column; the scheduler runs systems
+// concurrently only when no column is written by one and used by another.
+typedef enum {
+    EcsQueryAccessDefault, // treated as inout
+    EcsQueryAccessIn,
+    EcsQueryAccessOut,
+    EcsQueryAccessInOut
+} ecs_query_access_t;
+
 #define EcsQueryFlagSingleton 0b00000001
+#define EcsQueryFlagChanged 0b00000010 // only tables written since the last run
+#define EcsQueryFlagCascade 0b00000100 // (R, *) term ordering tables by depth, matches roots too
+#define EcsQueryFlagSparse 0b00001000 // component stored outside of tables, set when the query is built
+#define EcsQueryFlagTag 0b00010000 // zero-size id, matched through the type only, set when the query is built
+#define ECS_QUERY_TERM_COUNT 8
+#define ECS_QUERY_NO_COLUMN UINT32_MAX
 
 typedef struct {
     ecs_entity_t id;
     ecs_query_term_oper_t oper;
     uint16_t flags;
+    ecs_query_access_t access;
 } ecs_query_term_t;
 
 typedef struct {
-    ecs_query_term_t terms[8];
+    ecs_query_term_t terms[ECS_QUERY_TERM_COUNT];
 } ecs_query_t;
 
+// Matching form of a query: sorted AND / NOT ids plus the bloom of the AND
+// ids, so most archetypes are rejected with two mask tests. (R, *) terms are
+// not in the bloom, they match any pair of R.
+typedef struct {
+    uint64_t and_ids[ECS_QUERY_TERM_COUNT];
+    uint64_t not_ids[ECS_QUERY_TERM_COUNT];
+    uint64_t wildcard_ids[ECS_QUERY_TERM_COUNT];
+    uint8_t and_count;
+    uint8_t not_count;
+    uint8_t wildcard_count;
+    ecs_type_bloom_t and_bloom;
+} ecs_query_signature_t;
+
+// A matched archetype with the chunk offset of every term's column, resolved
+// once when the archetype is matched.
+typedef struct {
+    ecs_archetype_id_t archetype;
+    uint32_t column_offsets[ECS_QUERY_TERM_COUNT]; // ECS_QUERY_NO_COLUMN if absent
+    ecs_entity_t ids[ECS_QUERY_TERM_COUNT]; // id found for each term, the first pair of R for (R, *)
+} ecs_query_match_t;
+
+// Matches are kept partitioned: tables with rows first, empty ones after.
+// Archetypes swap themselves across the boundary through their query refs.
+// Cascading caches instead keep every table sorted by depth along the
+// cascade relation (roots first), and skip empty ones while iterating.
 typedef struct {
-    ecs_vec_t archetypes; // ecs_archetype_id
+    ecs_vec_t archetypes; // ecs_query_match_t
+    uint32_t active_count;
     ecs_query_t query;
+    ecs_query_signature_t signature;
+    uint32_t last_run; // world tick of the last iteration
+    ecs_vec_t observers; // ecs_archetype_observer_ref_t, copied to every matched archetype
+    uint32_t cascade; // relation index of the cascade term, 0 if there is none
+    uint32_t cascade_version; // version of the cascade relation the depth order was built for
+    bool cascade_dirty; // tables were added or removed since
 } ecs_query_cache_t;
 
 typedef struct {
     ecs_world_t *world;
-    ecs_vec_t *archetypes; // ecs_archetype_id
+    const ecs_query_t *query;
+    ecs_vec_t *archetypes; // ecs_query_match_t
+    uint32_t *active_count;
     ecs_archetype_t *archetype_p;
+    void *columns[ECS_QUERY_TERM_COUNT]; // per term, for the current chunk
+    const ecs_entity_t *ids; // per term, the id matched in the current table
     int current_archetype;
+    int current_chunk;
+    uint32_t offset; // table row of the first entity in the current chunk
     int count;
+    uint32_t tick; // stamped on written columns, 0 outside of systems
+    uint32_t last_run; // Changed() terms skip tables not written after it
+    uint8_t write_terms; // bit per term written by the iterating system
+    uint8_t changed_terms; // bit per Changed() term
+    uint8_t sparse_terms; // bit per sparse term, checked row by row
+    uint8_t sparse_values; // sparse terms with a value: runs are then single rows
+    uint32_t sparse_row; // next table row to check for the sparse terms
+    uint32_t sparse_end; // end of the rows checked before moving on
+    ecs_sparseset_t *sparse[ECS_QUERY_TERM_COUNT]; // per sparse term, its component's set
 } ecs_iter_t;
 
+typedef void (*ecs_iter_func)(ecs_iter_t *it);
+
 ECS_COMPONENT_DECLARE(EcsQueryId);
 
-bool ecs_query_match_type(ecs_query_t *query, ecs_type_t *type);
+void ecs_query_signature_init(ecs_query_signature_t *signature, const ecs_query_t *query);
+bool ecs_query_signature_match(const ecs_query_signature_t *signature, const ecs_type_info_t *type);
+bool ecs_query_match_type(ecs_query_t *query, const ecs_type_info_t *type);
+bool ecs_query_has_sparse_terms(ecs_world_t *world, const ecs_query_t *query);
+ecs_entity_t ecs_query_term_match(const ecs_type_info_t *type, ecs_entity_t id);
+void ecs_query_match_archetypes(ecs_world_t *world, ecs_query_t *query, ecs_vec_t *archetypes);
+void ecs_query_cache_add(ecs_world_t *world, EcsQueryId query, ecs_archetype_id_t archetype_id);
+void ecs_query_archetype_set_active(ecs_world_t *world, ecs_archetype_id_t archetype_id, bool active);
+void ecs_query_archetype_remove(ecs_world_t *world, ecs_archetype_id_t archetype_id);
 ecs_query_t *ecs_query_from_str(ecs_world_t *world, const char *str);
 EcsQueryId ecs_query_register(ecs_world_t *world, ecs_query_t *query);
 ecs_iter_t ecs_query(ecs_world_t *world, ecs_query_t *query);
 ecs_iter_t ecs_query_iter(ecs_world_t *world, EcsQueryId query);
+ecs_iter_t ecs_query_iter_since(ecs_world_t *world, EcsQueryId query, uint32_t *cursor);
 bool ecs_iter_next(ecs_iter_t *it);
+void ecs_iter_parallel(ecs_world_t *world, EcsQueryId query, ecs_iter_func func, uint32_t grain);
 void EcsQueryModule(ecs_world_t *world);
 
+// Query terms resolve to a precomputed slot; anything else falls back to a
+// lookup in the table.
+ECS_INLINE
+void *ecs_iter_column(ecs_iter_t *it, ecs_entity_t component) {
+    for (uint32_t i = 0; i < ECS_QUERY_TERM_COUNT && it->query->terms[i].id.value; i++) {
+        if (it->query->terms[i].id.value == component.value) {
+            return it->columns[i];
+        }
+    }
+
+    ecs_column_t *column = ecs_sparseset_get(&it->archetype_p->rows, component.value);
+
+    return column ? ecs_archetype_column_row(it->archetype_p, column, it->offset) : NULL;
+}
+
 #endif
@@ -1,7 +1,9 @@
+#include "ecs_pipeline.h"
 #include "ecs_query.h"
 #include "ecs_types.h"
 #include <ecs_world.h>
 #include <ecs_system.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,6 +24,7 @@ ecs_entity_t ecs_register_system(ecs_world_t *world, ecs_iter_func func, ecs_que
     ecs_add(world, entity, ecs_id(EcsQueryId));
     ecs_set(world, entity, ecs_id(EcsSystem), &(EcsSystem) {
         .func = func,
+        .order = world->pipeline.system_count++,
     });
     ecs_set(world, entity, ecs_id(EcsQueryId), &queryId);
     return entity;
@@ -39,36 +42,172 @@ ecs_entity_t ecs_system(
     return system;
 }
 
-void ecs_invoke_system(ecs_world_t *world, EcsSystem *system, EcsQueryId query) {
+// Columns the system writes are stamped with `tick`, and its Changed()
+// terms see what was written since its previous run.
+void ecs_invoke_system(ecs_world_t *world, EcsSystem *system, EcsQueryId query, uint32_t tick) {
     ecs_iter_t it = ecs_query_iter(world, query);
 
+    it.tick = tick;
+    ECS_VEC_GET(ecs_query_cache_t, &world->queries, query)->last_run = tick;
     while (ecs_iter_next(&it)) {
         system->func(&it);
     }
 }
 
-void ecs_invoke_systems(ecs_world_t *world, EcsQueryId query) {
-    ecs_iter_t it = ecs_query_iter(world, query);
-    while (ecs_iter_next(&it)) {
-        EcsSystem *systems = ecs_field(&it, EcsSystem);
-        EcsQueryId *queryIds = ecs_field(&it, EcsQueryId);
-
-        for (int i = 0; i < it.count; i++) {
-            ecs_invoke_system(world,
-                &systems[i],
-                queryIds[i]
-            );
+static ecs_command_buffer_t *ecs_system_stage(ecs_world_t *world, uint32_t index) {
+    while (world->system_stages.count <= index) {
+        ecs_command_buffer_init(ecs_vec_add(&world->system_stages));
+    }
+    return ECS_VEC_GET(ecs_command_buffer_t, &world->system_stages, index);
+}
+
+typedef struct {
+    ecs_world_t *world;
+    const ecs_pipeline_system_t *systems;
+    ecs_command_buffer_t *stages;
+    uint32_t first_tick;
+    uint32_t *indices; // systems of the wave
+    uint32_t count;
+    atomic_uint next;
+} ecs_system_wave_t;
+
+static void ecs_system_run(
+    ecs_world_t *world,
+    const ecs_pipeline_system_t *system,
+    ecs_command_buffer_t *stage,
+    uint32_t tick
+) {
+    EcsSystem callback = { .func = system->func };
+    ecs_command_buffer_t *previous = ecs_defer_set_stage(stage);
+
+    stage->tick = tick;
+    ecs_invoke_system(world, &callback, system->query, tick);
+    ecs_defer_set_stage(previous);
+}
+
+static void ecs_system_wave_job(void *ctx, uint32_t worker) {
+    ecs_system_wave_t *wave = ctx;
+    uint32_t next;
+
+    (void) worker;
+    while ((next = atomic_fetch_add(&wave->next, 1)) < wave->count) {
+        uint32_t index = wave->indices[next];
+        ecs_system_run(wave->world, &wave->systems[index], &wave->stages[index], wave->first_tick + index);
+    }
+}
+
+static void ecs_system_run_parallel(
+    ecs_world_t *world,
+    const ecs_pipeline_system_t *systems,
+    ecs_command_buffer_t *stages,
+    uint32_t count,
+    uint32_t first_tick
+) {
+    uint32_t *indices = malloc(count * sizeof(uint32_t));
+    uint32_t done = 0;
+
+    for (uint32_t w = 0; done < count; w++) {
+        ecs_system_wave_t wave = {
+            .world = world,
+            .systems = systems,
+            .stages = stages,
+            .first_tick = first_tick,
+            .indices = indices,
+        };
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (systems[i].wave == w) {
+                indices[wave.count++] = i;
+            }
+        }
+        atomic_init(&wave.next, 0);
+        ecs_worker_pool_run(&world->workers, ecs_system_wave_job, &wave);
+        done += wave.count;
+    }
+    free(indices);
+}
+
+// Systems of a phase record their structural changes into their own stage;
+// the stages are merged in system order once the whole phase has run. With
+// worker threads, systems that do not conflict run concurrently, and every
+// wave of them ends on a barrier. Each system gets its own change tick, in
+// declaration order.
+static void ecs_run_phase(ecs_world_t *world, const ecs_pipeline_system_t *systems, uint32_t count) {
+    uint32_t first_tick = ecs_world_write_tick(world);
+
+    if (count) {
+        ecs_system_stage(world, count - 1);
+    }
+    ecs_command_buffer_t *stages = world->system_stages.data;
+
+    world->change_tick += count;
+    ecs_defer_begin(world);
+    if (world->workers.count && count > 1) {
+        ecs_system_run_parallel(world, systems, stages, count, first_tick);
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            ecs_system_run(world, &systems[i], &stages[i], first_tick + i);
         }
     }
+    ecs_defer_end(world);
+
+    if (ecs_is_deferred(world)) {
+        return;
+    }
+    for (uint32_t i = 0; i < world->system_stages.count; i++) {
+        ecs_command_buffer_flush(world, ECS_VEC_GET(ecs_command_buffer_t, &world->system_stages, i));
+    }
 }
 
+// Number of extra threads used to run systems, 0 (the default) keeps every
+// phase on the calling thread.
+void ecs_set_threads(ecs_world_t *world, uint32_t count) {
+    ecs_worker_pool_fini(&world->workers);
+    ecs_worker_pool_init(&world->workers, count);
+}
+
+// The schedule is only rebuilt after systems or phases changed; systems
+// added while a frame runs are picked up by the next one.
 bool ecs_progress(ecs_world_t *world) {
-    ecs_invoke_systems(world, world->OnPreUpdateQuery);
-    ecs_invoke_systems(world, world->OnUpdateQuery);
-    ecs_invoke_systems(world, world->OnPostUpdateQuery);
+    if (world->pipeline.dirty) {
+        ecs_pipeline_build(world);
+    }
+
+    // a rebuild never happens mid-frame, so the schedule stays put
+    const ecs_pipeline_system_t *systems = world->pipeline.systems.data;
+    uint32_t begin = 0;
+
+    iter_vec(uint32_t, &world->pipeline.phase_ends) {
+        ecs_run_phase(world, systems + begin, iter_value - begin);
+        begin = iter_value;
+    }
+    ecs_world_flush_kills(world);
+    world->frame_count++;
     return true;
 }
 
+static void ecs_pipeline_changed(ecs_iter_t *it) {
+    ecs_pipeline_invalidate(it->world);
+}
+
+static void ecs_pipeline_phase_added(ecs_iter_t *it) {
+    for (int i = 0; i < it->count; i++) {
+        ecs_pipeline_phase_order(it->world, ecs_it_entity(it, i));
+    }
+    ecs_pipeline_invalidate(it->world);
+}
+
+// Creates a phase that runs after `depends_on` (none when its value is 0).
+ecs_entity_t ecs_phase(ecs_world_t *world, ecs_entity_t depends_on) {
+    ecs_entity_t phase = ecs_new(world);
+
+    ecs_add(world, phase, ecs_id(EcsPhase));
+    if (depends_on.value) {
+        ecs_add_pair(world, phase, ecs_id(EcsDependsOn), depends_on);
+    }
+    return phase;
+}
+
 void EcsSystemModule(ecs_world_t *world) {
     ECS_REGISTER_COMPONENT(world, EcsSystem);
     ECS_REGISTER_COMPONENT(world, EcsDependsOn);
@@ -79,31 +218,30 @@ void EcsSystemModule(ecs_world_t *world) {
     ECS_REGISTER_COMPONENT(world, EcsOnUpdate);
     ECS_REGISTER_COMPONENT(world, EcsOnPostUpdate);
 
-    ecs_query_t onPreUpdateQuery = query({
+    ecs_query_t system_query = query({
         .terms = {
-            { .id = ecs_make_pair(ecs_id(EcsPhase), ecs_id(EcsOnPreUpdate)), .oper = EcsQueryOperEqual },
             { .id = ecs_id(EcsSystem), .oper = EcsQueryOperEqual },
             { .id = ecs_id(EcsQueryId), .oper = EcsQueryOperEqual }
         },
     });
-
-    ecs_query_t onUpdateQuery = query({
+    ecs_query_t phase_query = query({
         .terms = {
-            { .id = ecs_make_pair(ecs_id(EcsPhase), ecs_id(EcsOnUpdate)), .oper = EcsQueryOperEqual },
-            { .id = ecs_id(EcsSystem), .oper = EcsQueryOperEqual },
-            { .id = ecs_id(EcsQueryId), .oper = EcsQueryOperEqual }
+            { .id = ecs_id(EcsPhase), .oper = EcsQueryOperEqual }
         },
     });
 
-    ecs_query_t onPostUpdateQuery = query({
-        .terms = {
-            { .id = ecs_make_pair(ecs_id(EcsPhase), ecs_id(EcsOnPostUpdate)), .oper = EcsQueryOperEqual },
-            { .id = ecs_id(EcsSystem), .oper = EcsQueryOperEqual },
-            { .id = ecs_id(EcsQueryId), .oper = EcsQueryOperEqual }
-        },
-    });
+    world->pipeline.system_query = ecs_query_register(world, &system_query);
+    world->pipeline.phase_query = ecs_query_register(world, &phase_query);
+
+    ecs_add_hook(world, ecs_id(EcsSystem), ecs_pipeline_changed);
+    ecs_set_hook(world, ecs_id(EcsSystem), ecs_pipeline_changed);
+    ecs_remove_hook(world, ecs_id(EcsSystem), ecs_pipeline_changed);
+    ecs_add_hook(world, ecs_id(EcsPhase), ecs_pipeline_phase_added);
+    ecs_remove_hook(world, ecs_id(EcsPhase), ecs_pipeline_changed);
 
-    world->OnPreUpdateQuery = ecs_query_register(world, &onPreUpdateQuery);
-    world->OnUpdateQuery = ecs_query_register(world, &onUpdateQuery);
-    world->OnPostUpdateQuery = ecs_query_register(world, &onPostUpdateQuery);
+    ecs_add(world, ecs_id(EcsOnPreUpdate), ecs_id(EcsPhase));
+    ecs_add(world, ecs_id(EcsOnUpdate), ecs_id(EcsPhase));
+    ecs_add_pair(world, ecs_id(EcsOnUpdate), ecs_id(EcsDependsOn), ecs_id(EcsOnPreUpdate));
+    ecs_add(world, ecs_id(EcsOnPostUpdate), ecs_id(EcsPhase));
+    ecs_add_pair(world, ecs_id(EcsOnPostUpdate), ecs_id(EcsDependsOn), ecs_id(EcsOnUpdate));
 }
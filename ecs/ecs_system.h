@@ -12,10 +12,10 @@
             free(func##query); \
 
 typedef struct ecs_world_t ecs_world_t;
-typedef void (*ecs_iter_func)(ecs_iter_t *it);
 
 typedef struct {
     ecs_iter_func func;
+    uint32_t order; // creation sequence, declaration order inside a phase
 } EcsSystem;
 
 ECS_TAGS(
@@ -37,6 +37,8 @@ ECS_COMPONENT_DECLARE(EcsOnPostUpdate);
 
 void EcsSystemModule(ecs_world_t *world);
 bool ecs_progress(ecs_world_t *world);
+void ecs_set_threads(ecs_world_t *world, uint32_t count);
+ecs_entity_t ecs_phase(ecs_world_t *world, ecs_entity_t depends_on);
 ecs_entity_t ecs_register_system(ecs_world_t *world, ecs_iter_func func, ecs_query_t *query);
 ecs_entity_t ecs_system(
     ecs_world_t *world,
@@ -0,0 +1,112 @@
+#include "ecs_type_table.h"
+#include "datastructure/ecs_map.h"
+#include "datastructure/ecs_vec.h"
+#include "ecs_types.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct {
+    const ecs_type_table_t *table;
+    const ecs_type_t *base;
+    ecs_entity_t component;
+} ecs_type_probe_t;
+
+ECS_INLINE
+const ecs_type_info_t *ecs_type_table_get(const ecs_type_table_t *table, uint32_t index) {
+    return *ECS_VEC_GET(ecs_type_info_t *, &table->infos, index);
+}
+
+static bool ecs_type_probe_equals(const void *ctx, uint32_t index) {
+    const ecs_type_probe_t *probe = ctx;
+    return key_equal(&ecs_type_table_get(probe->table, index)->ids, probe->base);
+}
+
+static bool ecs_type_probe_equals_add(const void *ctx, uint32_t index) {
+    const ecs_type_probe_t *probe = ctx;
+    return ecs_type_equals_add(&ecs_type_table_get(probe->table, index)->ids, probe->base, probe->component);
+}
+
+static bool ecs_type_probe_equals_remove(const void *ctx, uint32_t index) {
+    const ecs_type_probe_t *probe = ctx;
+    return ecs_type_equals_remove(&ecs_type_table_get(probe->table, index)->ids, probe->base, probe->component);
+}
+
+void ecs_type_table_init(ecs_type_table_t *table) {
+    ecs_hashmap_init(&table->map);
+    ecs_vec_init(&table->infos, sizeof(ecs_type_info_t *));
+}
+
+void ecs_type_table_fini(ecs_type_table_t *table) {
+    ecs_type_info_t **infos = table->infos.data;
+
+    for (size_t i = 0; i < table->infos.count; i++) {
+        ecs_vec_free(&infos[i]->ids);
+        free(infos[i]);
+    }
+    ecs_vec_free(&table->infos);
+    ecs_hashmap_fini(&table->map);
+}
+
+// Takes ownership of `ids`.
+static const ecs_type_info_t *ecs_type_table_insert(ecs_type_table_t *table, ecs_type_t ids, uint64_t hash) {
+    ecs_type_info_t *info = malloc(sizeof(ecs_type_info_t));
+    const uint64_t *data = ids.data;
+
+    info->ids = ids;
+    info->hash = hash;
+    info->bloom = (ecs_type_bloom_t) {0};
+    for (size_t i = 0; i < ids.count; i++) {
+        ecs_type_bloom_add(&info->bloom, data[i]);
+    }
+    ecs_hashmap_put(&table->map, hash, table->infos.count);
+    ecs_vec_push(&table->infos, &info);
+    return info;
+}
+
+// `ids` must be sorted; it is copied the first time the type is seen.
+const ecs_type_info_t *ecs_type_table_intern(ecs_type_table_t *table, const ecs_type_t *ids) {
+    ecs_type_probe_t probe = { .table = table, .base = ids };
+    uint64_t hash = hash_key(ids);
+    uint32_t index;
+
+    if (ecs_hashmap_get(&table->map, hash, ecs_type_probe_equals, &probe, &index)) {
+        return ecs_type_table_get(table, index);
+    }
+    return ecs_type_table_insert(table, ecs_type_from_other(ids), hash);
+}
+
+const ecs_type_info_t *ecs_type_table_intern_add(
+    ecs_type_table_t *table,
+    const ecs_type_info_t *base,
+    ecs_entity_t component
+) {
+    ecs_type_probe_t probe = { .table = table, .base = &base->ids, .component = component };
+    uint64_t hash = hash_key_toggle(base->hash, component.value);
+    uint32_t index;
+
+    if (ecs_type_info_has(base, component)) {
+        return base;
+    }
+    if (ecs_hashmap_get(&table->map, hash, ecs_type_probe_equals_add, &probe, &index)) {
+        return ecs_type_table_get(table, index);
+    }
+    return ecs_type_table_insert(table, ecs_type_from_other_add(&base->ids, component), hash);
+}
+
+const ecs_type_info_t *ecs_type_table_intern_remove(
+    ecs_type_table_t *table,
+    const ecs_type_info_t *base,
+    ecs_entity_t component
+) {
+    ecs_type_probe_t probe = { .table = table, .base = &base->ids, .component = component };
+    uint64_t hash = hash_key_toggle(base->hash, component.value);
+    uint32_t index;
+
+    if (!ecs_type_info_has(base, component)) {
+        return base;
+    }
+    if (ecs_hashmap_get(&table->map, hash, ecs_type_probe_equals_remove, &probe, &index)) {
+        return ecs_type_table_get(table, index);
+    }
+    return ecs_type_table_insert(table, ecs_type_from_other_remove(&base->ids, component), hash);
+}
@@ -0,0 +1,20 @@
+#ifndef ECS_TYPE_TABLE_H
+    #define ECS_TYPE_TABLE_H
+    #include "datastructure/ecs_map.h"
+    #include "datastructure/ecs_vec.h"
+    #include "ecs_types.h"
+
+// Interns every distinct sorted id list once. Lookups of an existing type
+// never allocate, including the +/- one id variants used by graph edges.
+typedef struct {
+    ecs_hashmap_t map; // hash -> index in infos
+    ecs_vec_t infos; // ecs_type_info_t *
+} ecs_type_table_t;
+
+void ecs_type_table_init(ecs_type_table_t *table);
+void ecs_type_table_fini(ecs_type_table_t *table);
+const ecs_type_info_t *ecs_type_table_intern(ecs_type_table_t *table, const ecs_type_t *ids);
+const ecs_type_info_t *ecs_type_table_intern_add(ecs_type_table_t *table, const ecs_type_info_t *base, ecs_entity_t component);
+const ecs_type_info_t *ecs_type_table_intern_remove(ecs_type_table_t *table, const ecs_type_info_t *base, ecs_entity_t component);
+
+#endif
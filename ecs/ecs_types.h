@@ -4,6 +4,7 @@
     #include <stddef.h>
     #include <stdint.h>
     #include <stdio.h>
+    #include "datastructure/ecs_map.h"
     #include "datastructure/ecs_vec.h"
     #include "ecs_config.h"
     #include "ecs_vec_sort.h"
@@ -55,6 +56,8 @@
 
 typedef struct ecs_world_t ecs_world_t;
 
+// Pairs keep the full target index in the low word and the relation index in
+// the next 31 bits; the top bit tells them apart from entities.
 typedef union {
     struct {
         uint32_t index;
@@ -62,8 +65,9 @@ typedef union {
         uint16_t flags;
     };
     struct {
-        uint32_t relation;
-        uint16_t target;
+        uint32_t target;
+        uint32_t relation : 31;
+        uint32_t is_pair : 1;
     } relation;
     uint64_t value;
 } ecs_entity_t;
@@ -83,6 +87,43 @@ typedef ecs_vec_t ecs_type_t;
 typedef size_t ecs_size_t;
 typedef uint64_t ecs_component_id_t;
 
+typedef struct {
+    uint64_t bits[2];
+} ecs_type_bloom_t;
+
+// Interned sorted id list, owned by the world type table. Handles are stable
+// and never mutated, so two types are equal iff their handles are.
+typedef struct {
+    ecs_type_t ids;
+    uint64_t hash;
+    ecs_type_bloom_t bloom;
+} ecs_type_info_t;
+
+// Two bits out of 128 per id.
+ECS_INLINE
+ecs_type_bloom_t ecs_type_bloom_of(uint64_t id) {
+    uint64_t h = hash64(id);
+    ecs_type_bloom_t bloom = {0};
+
+    bloom.bits[(h >> 6) & 1] |= 1ULL << (h & 63);
+    bloom.bits[(h >> 38) & 1] |= 1ULL << ((h >> 32) & 63);
+    return bloom;
+}
+
+ECS_INLINE
+void ecs_type_bloom_add(ecs_type_bloom_t *bloom, uint64_t id) {
+    ecs_type_bloom_t bits = ecs_type_bloom_of(id);
+
+    bloom->bits[0] |= bits.bits[0];
+    bloom->bits[1] |= bits.bits[1];
+}
+
+// False means at least one id of `subset` is definitely missing from `set`.
+ECS_INLINE
+bool ecs_type_bloom_may_contain(ecs_type_bloom_t set, ecs_type_bloom_t subset) {
+    return ((subset.bits[0] & ~set.bits[0]) | (subset.bits[1] & ~set.bits[1])) == 0;
+}
+
 ECS_INLINE
 ecs_type_t ecs_type_from_other(const ecs_type_t *other) {
     ecs_type_t type;
@@ -101,19 +142,6 @@ ecs_type_t ecs_type_from_other_add(const ecs_type_t *other, ecs_entity_t compone
     return type;
 }
 
-ECS_INLINE
-ecs_type_t *ecs_type_from_other_add_temp(const ecs_type_t *other, ecs_entity_t component) {
-    static ecs_type_t type = {0};
-
-    if (type.data == NULL) {
-        ecs_vec_init(&type, sizeof(ecs_entity_t));
-    }
-    ecs_vec_copy_already_init(other, &type);
-    ecs_vec_push(&type, &component);
-    ecs_vec_sort_last_u64(&type);
-    return &type;
-}
-
 ECS_INLINE
 ecs_type_t ecs_type_from_other_remove(const ecs_type_t *other, ecs_entity_t component) {
     ecs_type_t type;
@@ -129,31 +157,98 @@ ecs_type_t ecs_type_from_other_remove(const ecs_type_t *other, ecs_entity_t comp
 }
 
 ECS_INLINE
-ecs_type_t *ecs_type_from_other_remove_temp(const ecs_type_t *other, ecs_entity_t component) {
-    static ecs_type_t type = {0};
+bool ecs_type_has(const ecs_type_t *type, ecs_entity_t component) {
+    const uint64_t *ids = (const uint64_t*)type->data;
+    for (size_t i = 0; i < type->count; i++) {
+        if (ids[i] == component.value) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    if (type.data == NULL) {
-        ecs_vec_init(&type, sizeof(ecs_entity_t));
+ECS_INLINE
+bool ecs_type_info_has(const ecs_type_info_t *type, ecs_entity_t component) {
+    if (!ecs_type_bloom_may_contain(type->bloom, ecs_type_bloom_of(component.value))) {
+        return false;
     }
-    ecs_vec_copy_already_init(other, &type);
-    for (size_t i = 0; i < type.count; i++) {
-        if (((uint64_t *) type.data)[i] == component.value) {
-            ecs_vec_remove_ordered(&type, i);
-            break;
+
+    const uint64_t *ids = type->ids.data;
+    size_t low = 0;
+    size_t high = type->ids.count;
+
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (ids[mid] < component.value) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
     }
-    return &type;
+    return low < type->ids.count && ids[low] == component.value;
 }
 
+// Pairs of one relation sort next to each other; returns the first of them,
+// or a zero id if the type has none.
 ECS_INLINE
-bool ecs_type_has(const ecs_type_t *type, ecs_entity_t component) {
-    const uint64_t *ids = (const uint64_t*)type->data;
-    for (size_t i = 0; i < type->count; i++) {
-        if (ids[i] == component.value) {
-            return true;
+ecs_entity_t ecs_type_info_find_relation(const ecs_type_info_t *type, uint32_t relation) {
+    ecs_entity_t first = { .relation = { .target = 0, .relation = relation, .is_pair = 1 } };
+    const uint64_t *ids = type->ids.data;
+    size_t low = 0;
+    size_t high = type->ids.count;
+
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (ids[mid] < first.value) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
     }
-    return false;
+    if (low < type->ids.count && ids[low] >> 32 == first.value >> 32) {
+        return (ecs_entity_t) { .value = ids[low] };
+    }
+    return (ecs_entity_t) { .value = 0 };
+}
+
+// True if `type` is exactly `base` plus `component`, without building it.
+ECS_INLINE
+bool ecs_type_equals_add(const ecs_type_t *type, const ecs_type_t *base, ecs_entity_t component) {
+    const uint64_t *ids = type->data;
+    const uint64_t *base_ids = base->data;
+    bool inserted = false;
+
+    if (type->count != base->count + 1) {
+        return false;
+    }
+    for (size_t i = 0, j = 0; i < type->count; i++) {
+        if (!inserted && ids[i] == component.value) {
+            inserted = true;
+        } else if (j >= base->count || ids[i] != base_ids[j++]) {
+            return false;
+        }
+    }
+    return inserted;
+}
+
+// True if `type` is exactly `base` minus `component`, without building it.
+ECS_INLINE
+bool ecs_type_equals_remove(const ecs_type_t *type, const ecs_type_t *base, ecs_entity_t component) {
+    const uint64_t *ids = type->data;
+    const uint64_t *base_ids = base->data;
+    bool removed = false;
+
+    if (type->count + 1 != base->count) {
+        return false;
+    }
+    for (size_t i = 0, j = 0; j < base->count; j++) {
+        if (!removed && base_ids[j] == component.value) {
+            removed = true;
+        } else if (ids[i++] != base_ids[j]) {
+            return false;
+        }
+    }
+    return removed;
 }
 
 ECS_INLINE
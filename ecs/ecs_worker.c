@@ -0,0 +1,111 @@
+#include "ecs_worker.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Set while this thread runs a job, so nested runs stay on the thread.
+static _Thread_local bool ecs_worker_in_job = false;
+
+typedef struct {
+    ecs_worker_pool_t *pool;
+    uint32_t index;
+} ecs_worker_arg_t;
+
+static void *ecs_worker_main(void *arg) {
+    ecs_worker_arg_t self = *(ecs_worker_arg_t *) arg;
+    ecs_worker_pool_t *pool = self.pool;
+    uint64_t seen = 0;
+
+    free(arg);
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->quit) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        ecs_worker_in_job = true;
+        pool->job(pool->ctx, self.index);
+        ecs_worker_in_job = false;
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void ecs_worker_pool_init(ecs_worker_pool_t *pool, uint32_t count) {
+    pool->threads = count ? malloc(count * sizeof(pthread_t)) : NULL;
+    pool->count = count;
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->job = NULL;
+    pool->ctx = NULL;
+    pool->quit = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (uint32_t i = 0; i < count; i++) {
+        ecs_worker_arg_t *arg = malloc(sizeof(ecs_worker_arg_t));
+
+        *arg = (ecs_worker_arg_t) { .pool = pool, .index = i };
+        pthread_create(&pool->threads[i], NULL, ecs_worker_main, arg);
+    }
+}
+
+void ecs_worker_pool_fini(ecs_worker_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint32_t i = 0; i < pool->count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    pool->threads = NULL;
+    pool->count = 0;
+}
+
+// Runs `job` once on every thread of the pool and on the caller, and returns
+// when all of them are done. Called from inside a job, it runs `job` once on
+// the current thread as worker 0.
+void ecs_worker_pool_run(ecs_worker_pool_t *pool, ecs_worker_job_t job, void *ctx) {
+    if (pool->count == 0 || ecs_worker_in_job) {
+        bool nested = ecs_worker_in_job;
+
+        ecs_worker_in_job = true;
+        job(ctx, 0);
+        ecs_worker_in_job = nested;
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->ctx = ctx;
+    pool->pending = pool->count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    ecs_worker_in_job = true;
+    job(ctx, pool->count);
+    ecs_worker_in_job = false;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
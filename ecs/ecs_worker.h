@@ -0,0 +1,36 @@
+#ifndef ECS_WORKER_H
+    #define ECS_WORKER_H
+    #include "ecs_config.h"
+    #include <pthread.h>
+    #include <stdbool.h>
+    #include <stdint.h>
+
+// `worker` is in [0, ecs_worker_pool_size(pool)); the calling thread always
+// takes the last index.
+typedef void (*ecs_worker_job_t)(void *ctx, uint32_t worker);
+
+// Fixed set of threads that all run the same job, then meet at a barrier.
+// With zero threads every job runs inline on the caller.
+typedef struct {
+    pthread_t *threads;
+    uint32_t count;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t generation; // bumped for every job
+    uint32_t pending; // threads still running the current job
+    ecs_worker_job_t job;
+    void *ctx;
+    bool quit;
+} ecs_worker_pool_t;
+
+void ecs_worker_pool_init(ecs_worker_pool_t *pool, uint32_t count);
+void ecs_worker_pool_fini(ecs_worker_pool_t *pool);
+void ecs_worker_pool_run(ecs_worker_pool_t *pool, ecs_worker_job_t job, void *ctx);
+
+ECS_INLINE
+uint32_t ecs_worker_pool_size(const ecs_worker_pool_t *pool) {
+    return pool->count + 1;
+}
+
+#endif
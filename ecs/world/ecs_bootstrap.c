@@ -8,10 +8,12 @@ ECS_COMPONENT_DEFINE(EcsWildcard);
 ECS_COMPONENT_DEFINE(EcsChildOf);
 ECS_COMPONENT_DEFINE(EcsComponent);
 
-void OnAddName(ecs_world_t *world, ecs_entity_t entity) {
-    EcsName *name = ecs_get(world, entity, ecs_id(EcsName));
+void OnAddName(ecs_iter_t *it) {
+    EcsName *name = ecs_field(it, EcsName);
 
-    ecs_strmap_set(&world->entity_map, *name, entity);
+    for (int i = 0; i < it->count; i++) {
+        ecs_strmap_set(&it->world->entity_map, name[i], ecs_it_entity(it, i));
+    }
 }
 
 void EcsBootstrapModule(ecs_world_t *world) {
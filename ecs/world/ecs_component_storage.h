@@ -8,16 +8,20 @@
     #include "ecs_vec.h"
     #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 
-typedef void (*ecs_component_hook_call)(ecs_world_t *, ecs_entity_t);
+// Hooks receive an iterator over a row range of one chunk; the component is
+// its only term.
+typedef void (*ecs_component_hook_call)(ecs_iter_t *it);
 
 typedef struct {
     size_t size;
     ecs_vec_t archetypes;
-    ecs_component_hook_call add_hook; // ecs_component_hook_call
-    ecs_component_hook_call remove_hook; // ecs_component_hook_call
-    ecs_component_hook_call set_hook; // ecs_component_hook_call
+    ecs_component_hook_call on_add;
+    ecs_component_hook_call on_remove; // runs while the rows still hold the component
+    ecs_component_hook_call on_set;
     ecs_observer_t observer;
+    ecs_sparseset_t *sparse; // <entity index, value> when kept out of tables, NULL otherwise
 } ecs_component_record_t;
 
 typedef struct {
@@ -37,6 +41,10 @@ void ecs_component_storage_fini(ecs_component_storage_t *storage) {
         ecs_component_record_t *record = &records[i];
         ecs_vec_free(&record->archetypes);
         ecs_observer_fini(&record->observer);
+        if (record->sparse) {
+            ecs_sparseset_fini(record->sparse);
+            free(record->sparse);
+        }
     }
     ecs_sparseset_fini(&storage->component_meta);
 }
@@ -46,13 +54,27 @@ void ecs_component_storage_set(ecs_component_storage_t *storage, ecs_entity_t en
     ecs_sparseset_insert(&storage->component_meta, entity.value, &(ecs_component_record_t) {
         .size = size,
         .archetypes = ecs_vec_create(sizeof(ecs_archetype_id_t)),
-        .add_hook = NULL,
-        .remove_hook = NULL,
-        .set_hook = NULL,
-        .observer = ecs_observer_new()
+        .on_add = NULL,
+        .on_remove = NULL,
+        .on_set = NULL,
+        .observer = ecs_observer_new(),
+        .sparse = NULL
     });
 }
 
+// The set is allocated on its own: records move when the meta set grows.
+// Tags still get one byte per value, so every present entity has an address.
+ECS_INLINE
+void ecs_component_storage_set_sparse(ecs_component_storage_t *storage, ecs_entity_t entity) {
+    ecs_component_record_t *record = ecs_sparseset_get(&storage->component_meta, entity.value);
+
+    if (record->sparse) {
+        return;
+    }
+    record->sparse = malloc(sizeof(ecs_sparseset_t));
+    ecs_sparseset_init(record->sparse, record->size ? record->size : 1);
+}
+
 ECS_INLINE
 size_t ecs_component_storage_get_component_size(ecs_component_storage_t *storage, ecs_entity_t entity) {
     ecs_component_record_t *meta = ecs_sparseset_get(&storage->component_meta, entity.value);
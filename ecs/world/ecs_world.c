@@ -1,5 +1,6 @@
 #include "ecs_archetype.h"
 #include "ecs_bootstrap.h"
+#include "ecs_chunk_pool.h"
 #include "ecs_component_storage.h"
 #include "ecs_config.h"
 #include "ecs_entity.h"
@@ -27,13 +28,28 @@ ecs_world_t *ecs_init(void) {
     ecs_type_t default_type = ECS_VEC_RAW(ecs_entity_t);
 
     ecs_vec_init(&world->archetypes, sizeof(ecs_archetype_t));
+    ecs_vec_init(&world->free_archetype_ids, sizeof(ecs_archetype_id_t));
+    ecs_vec_init(&world->kill_queue, sizeof(ecs_entity_t));
+    world->frame_count = 0;
+    world->change_tick = 0;
+    world->tick_seen = false;
+    world->defer_depth = 0;
+    ecs_command_buffer_init(&world->commands);
+    world->system_stages = (ecs_vec_t) { .size = sizeof(ecs_command_buffer_t) };
+    ecs_worker_pool_init(&world->workers, 0);
+    ecs_pipeline_init(&world->pipeline);
+    ecs_chunk_pool_init(&world->chunk_pool);
     ecs_vec_init(&world->queries, sizeof(ecs_query_cache_t));
     ecs_strmap_init(&world->entity_map, 1000);
     ecs_entity_manager_init(&world->entity_manager);
+    ecs_type_table_init(&world->type_table);
     ecs_hashmap_init(&world->archetype_map);
     ecs_component_storage_init(&world->component_storage);
-    ecs_archetype_create(world, &default_type);
+    ecs_archetype_get_or_create(world, &default_type);
     ecs_sparseset_init(&world->component_archetypes, sizeof(ecs_vec_t));
+    ecs_sparseset_init(&world->target_pairs, sizeof(ecs_vec_t));
+    world->sparse_components = (ecs_vec_t) { .size = sizeof(ecs_entity_t) };
+    ecs_sparseset_init(&world->cascade_versions, sizeof(uint32_t));
 
     ecs_new(world);
 
@@ -52,18 +68,31 @@ ecs_world_t *ecs_init(void) {
 }
 
 void ecs_fini(ecs_world_t *world) {
+    ecs_worker_pool_fini(&world->workers);
+    ecs_pipeline_fini(&world->pipeline);
     ecs_archetype_t *archetypes = world->archetypes.data;
     uint32_t archetype_count = world->archetypes.count;
 
     for (uint32_t i = 0; i < archetype_count; i++) {
-        ecs_archetype_fini(&archetypes[i]);
+        if (ecs_archetype_is_alive(&archetypes[i])) {
+            ecs_archetype_fini(&archetypes[i]);
+        }
     }
     ecs_vec_free(&world->archetypes);
+    ecs_vec_free(&world->free_archetype_ids);
+    ecs_vec_free(&world->kill_queue);
+    ecs_command_buffer_fini(&world->commands);
+    iter_vec(ecs_command_buffer_t, &world->system_stages) {
+        ecs_command_buffer_fini(&iter_value);
+    }
+    ecs_vec_free(&world->system_stages);
+    ecs_chunk_pool_fini(&world->chunk_pool);
     ecs_query_cache_t *queries = world->queries.data;
     uint32_t query_count = world->queries.count;
 
     for (uint32_t i = 0; i < query_count; i++) {
         ecs_vec_free(&queries[i].archetypes);
+        ecs_vec_free(&queries[i].observers);
     }
     ecs_vec_free(&world->queries);
 
@@ -72,6 +101,7 @@ void ecs_fini(ecs_world_t *world) {
     ecs_entity_manager_fini(&world->entity_manager);
 
     ecs_hashmap_fini(&world->archetype_map);
+    ecs_type_table_fini(&world->type_table);
 
     ecs_component_storage_fini(&world->component_storage);
 
@@ -83,45 +113,112 @@ void ecs_fini(ecs_world_t *world) {
     }
     ecs_sparseset_fini(&world->component_archetypes);
 
+    ecs_vec_t *target_pairs = world->target_pairs.dense.data;
+    for (uint32_t i = 0; i < world->target_pairs.dense.count; i++) {
+        ecs_vec_free(&target_pairs[i]);
+    }
+    ecs_sparseset_fini(&world->target_pairs);
+    ecs_vec_free(&world->sparse_components);
+    ecs_sparseset_fini(&world->cascade_versions);
+
     free(world);
 }
 
-ecs_archetype_id_t ecs_archetype_create(ecs_world_t *world, ecs_type_t *type) {
-    ecs_archetype_id_t id = world->archetypes.count;
-    ecs_hashmap_put(&world->archetype_map, type, id);
+static ecs_vec_t *ecs_world_component_archetypes(ecs_world_t *world, ecs_entity_t component) {
+    ecs_vec_t *archetypes = ecs_sparseset_get(&world->component_archetypes, component.value);
+
+    if (!archetypes) {
+        ecs_vec_t vec = ecs_vec_create(sizeof(ecs_archetype_id_t));
+        ecs_sparseset_insert(&world->component_archetypes, component.value, &vec);
+        archetypes = ecs_sparseset_get(&world->component_archetypes, component.value);
+    }
+    return archetypes;
+}
+
+static ecs_entity_t ecs_world_wildcard_of(ecs_entity_t pair) {
+    return ecs_make_pair(ecs_pair_relation(pair), ecs_id(EcsWildcard));
+}
 
-    ecs_archetype_t *archetype = ecs_vec_add(&world->archetypes);
-    ecs_archetype_init(archetype);
+// True if the id at `index` (which may be -1) is a pair of the same relation.
+static bool ecs_world_same_relation(const ecs_type_info_t *type, uint32_t index, ecs_entity_t pair) {
+    if (index >= type->ids.count) {
+        return false;
+    }
+    ecs_entity_t other = *ECS_VEC_GET(ecs_entity_t, &type->ids, index);
+    return ecs_is_pair(other) && other.relation.relation == pair.relation.relation;
+}
+
+// Remembers that tables with (R, target) exist, so the target's deletion
+// only needs to visit them.
+static void ecs_world_index_target_pair(ecs_world_t *world, ecs_entity_t pair) {
+    ecs_vec_t *pairs = ecs_sparseset_get(&world->target_pairs, pair.relation.target);
+
+    if (!pairs) {
+        ecs_vec_t vec = ecs_vec_create(sizeof(ecs_entity_t));
+        ecs_sparseset_insert(&world->target_pairs, pair.relation.target, &vec);
+        pairs = ecs_sparseset_get(&world->target_pairs, pair.relation.target);
+    }
+    ecs_vec_push(pairs, &pair);
+}
+
+// Tables holding (relation, target), NULL if there never was one. Entries may
+// be empty tables.
+const ecs_vec_t *ecs_pair_archetypes(ecs_world_t *world, ecs_entity_t relation, ecs_entity_t target) {
+    return ecs_sparseset_get(&world->component_archetypes, ecs_make_pair(relation, target).value);
+}
 
-    for (uint32_t i = 0; i < type->count; i++) {
-        ecs_entity_t component = *ECS_VEC_GET(ecs_entity_t, type, i);
+ecs_archetype_id_t ecs_archetype_create(ecs_world_t *world, const ecs_type_info_t *type) {
+    ecs_archetype_id_t id;
+    ecs_archetype_t *archetype;
+
+    if (world->free_archetype_ids.count) {
+        id = *ECS_VEC_GET_LAST(ecs_archetype_id_t, &world->free_archetype_ids);
+        ecs_vec_remove_last(&world->free_archetype_ids);
+        archetype = ecs_world_get_archetype(world, id);
+    } else {
+        id = world->archetypes.count;
+        archetype = ecs_vec_add(&world->archetypes);
+    }
+    ecs_hashmap_put(&world->archetype_map, type->hash, id);
+    ecs_archetype_init(archetype, type, &world->chunk_pool);
+    archetype->empty_since = world->frame_count;
+
+    for (uint32_t i = 0; i < type->ids.count; i++) {
+        ecs_entity_t component = *ECS_VEC_GET(ecs_entity_t, &type->ids, i);
         ecs_archetype_add_row(
             archetype,
             component,
             ecs_component_storage_get_component_size(&world->component_storage, component)
         );
 
-        ecs_vec_t *component_archetypes = ecs_sparseset_get(&world->component_archetypes, component.value);
-        if (!component_archetypes) {
-            ecs_vec_t vec = ecs_vec_create(sizeof(ecs_archetype_id_t));
-            ecs_sparseset_insert(&world->component_archetypes, component.value, &vec);
-            component_archetypes = ecs_sparseset_get(&world->component_archetypes, component.value);
+        if (ecs_is_pair(component) && !ecs_sparseset_exists(&world->component_archetypes, component.value)) {
+            ecs_world_index_target_pair(world, component);
+        }
+        ecs_vec_push(ecs_world_component_archetypes(world, component), &id);
+
+        // (R, *) lists every table with a pair of R, once
+        if (ecs_is_pair(component) && !ecs_world_same_relation(type, i - 1, component)) {
+            ecs_vec_push(ecs_world_component_archetypes(world, ecs_world_wildcard_of(component)), &id);
         }
-        ecs_vec_push(component_archetypes, &id);
     }
 
     ecs_query_cache_t *queries = world->queries.data;
     uint32_t len = world->queries.count;
 
     for (uint32_t i = 0; i < len; i++) {
-        if (ecs_query_match_type(&queries[i].query, type)) {
-            ecs_vec_push(&queries[i].archetypes, &id);
+        if (ecs_query_signature_match(&queries[i].signature, type)) {
+            ecs_query_cache_add(world, i, id);
         }
     }
 
     return id;
 }
 
+static void ecs_world_archetype_emptied(ecs_world_t *world, ecs_archetype_id_t archetype_id) {
+    ecs_world_get_archetype(world, archetype_id)->empty_since = world->frame_count;
+    ecs_query_archetype_set_active(world, archetype_id, false);
+}
+
 void ecs_remove_entity_from_archetype(
     ecs_world_t *world,
     ecs_archetype_t *archetype,
@@ -132,6 +229,9 @@ void ecs_remove_entity_from_archetype(
     ecs_archetype_remove_result_t remove_result = ecs_archetype_remove_entity(archetype, record->row);
     ecs_world_handle_archetype_remove(world, remove_result);
 
+    if (archetype->entities.count == 0) {
+        ecs_world_archetype_emptied(world, record->archetype_id);
+    }
     record->archetype_id = new_archetype_id;
     record->row = new_row;
 }
@@ -147,111 +247,760 @@ void ecs_world_migrate_entity(
     size_t new_row = ecs_archetype_add_entity(new_archetype, entity);
     ecs_archetype_t *archetype = ecs_world_get_archetype(world, record->archetype_id);
 
+    if (new_row == 0) {
+        ecs_query_archetype_set_active(world, new_archetype_id, true);
+    }
+    ecs_archetype_touch(new_archetype, ecs_world_write_tick(world));
     ecs_archetype_migrate_entity(archetype, new_archetype, record->row, new_row);
 
     ecs_remove_entity_from_archetype(world, archetype, record, new_archetype_id, new_row);
 }
 
+// Moves `entity` to another table without firing any hook.
+void ecs_world_move_entity(ecs_world_t *world, ecs_entity_t entity, ecs_archetype_id_t archetype_id) {
+    ecs_world_migrate_entity(world, entity, ecs_world_get_record(world, entity), archetype_id);
+}
+
+typedef struct {
+    ecs_world_t *world;
+    const ecs_type_info_t *type;
+} ecs_archetype_probe_t;
+
+static bool ecs_archetype_type_equals(const void *ctx, uint32_t archetype_id) {
+    const ecs_archetype_probe_t *probe = ctx;
+    return ecs_world_get_archetype(probe->world, archetype_id)->type == probe->type;
+}
+
+// Types are interned, so the map only ever compares handles.
+ecs_archetype_id_t ecs_archetype_for_type(ecs_world_t *world, const ecs_type_info_t *type) {
+    ecs_archetype_probe_t probe = { .world = world, .type = type };
+    ecs_archetype_id_t archetype_id;
+
+    if (ecs_hashmap_get(&world->archetype_map, type->hash, ecs_archetype_type_equals, &probe, &archetype_id)) {
+        return archetype_id;
+    }
+    return ecs_archetype_create(world, type);
+}
+
+ecs_archetype_id_t ecs_archetype_get_or_create(ecs_world_t *world, ecs_type_t *type) {
+    return ecs_archetype_for_type(world, ecs_type_table_intern(&world->type_table, type));
+}
+
+static ecs_archetype_id_t ecs_archetype_find_neighbour(
+    ecs_world_t *world,
+    ecs_archetype_id_t archetype_id,
+    ecs_entity_t component,
+    bool add
+) {
+    const ecs_type_info_t *type = ecs_world_get_archetype(world, archetype_id)->type;
+
+    type = add
+        ? ecs_type_table_intern_add(&world->type_table, type, component)
+        : ecs_type_table_intern_remove(&world->type_table, type, component);
+    return ecs_archetype_for_type(world, type);
+}
+
+// Depth orders along the pair's relation may be stale. Only relations some
+// query cascades on have a version.
+static void ecs_world_pair_changed(ecs_world_t *world, ecs_entity_t pair) {
+    uint32_t *version = ecs_sparseset_get(&world->cascade_versions, pair.relation.relation);
+
+    if (version) {
+        (*version)++;
+    }
+}
+
+ecs_archetype_id_t ecs_world_edge_add(
+    ecs_world_t *world,
+    ecs_archetype_id_t archetype_id,
+    ecs_entity_t component
+) {
+    if (ecs_is_pair(component)) {
+        ecs_world_pair_changed(world, component);
+    }
+    ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+    ecs_archetype_id_t *cached_archetype = ecs_smallmap_get(&archetype->add_edge, component.value);
+
+    if (cached_archetype != NULL) {
+        return *cached_archetype;
+    }
+
+    ecs_archetype_id_t new_archetype_id = ecs_archetype_find_neighbour(world, archetype_id, component, true);
+    // refresh because the archetype may have reallocated
+    archetype = ecs_world_get_archetype(world, archetype_id);
+    ecs_smallmap_set(&archetype->add_edge, component.value, new_archetype_id);
+    ecs_smallmap_set(&ecs_world_get_archetype(world, new_archetype_id)->remove_edge, component.value, archetype_id);
+    return new_archetype_id;
+}
+
+ecs_archetype_id_t ecs_world_edge_remove(
+    ecs_world_t *world,
+    ecs_archetype_id_t archetype_id,
+    ecs_entity_t component
+) {
+    if (ecs_is_pair(component)) {
+        ecs_world_pair_changed(world, component);
+    }
+    ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+    ecs_archetype_id_t *cached_archetype = ecs_smallmap_get(&archetype->remove_edge, component.value);
+
+    if (cached_archetype != NULL) {
+        return *cached_archetype;
+    }
+
+    ecs_archetype_id_t new_archetype_id = ecs_archetype_find_neighbour(world, archetype_id, component, false);
+    // refresh because the archetype may have reallocated
+    archetype = ecs_world_get_archetype(world, archetype_id);
+    ecs_smallmap_set(&archetype->remove_edge, component.value, new_archetype_id);
+    ecs_smallmap_set(&ecs_world_get_archetype(world, new_archetype_id)->add_edge, component.value, archetype_id);
+    return new_archetype_id;
+}
+
+// Sparse components never move the entity: adding or removing one only
+// touches the component's own set.
+static void ecs_world_sparse_add(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component, ecs_component_record_t *component_record) {
+    if (ecs_sparseset_exists(component_record->sparse, entity.index)) {
+        return;
+    }
+    ecs_sparseset_ensure(component_record->sparse, entity.index);
+    if (component_record->on_add) {
+        ecs_entity_record_t *record = ecs_world_get_record(world, entity);
+        ecs_world_invoke_hook(world, component_record->on_add, component, record->archetype_id, record->row, 1);
+    }
+}
+
+static void ecs_world_sparse_remove(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component, ecs_component_record_t *component_record) {
+    if (!ecs_sparseset_exists(component_record->sparse, entity.index)) {
+        return;
+    }
+    if (component_record->on_remove) {
+        ecs_entity_record_t *record = ecs_world_get_record(world, entity);
+        ecs_world_invoke_hook(world, component_record->on_remove, component, record->archetype_id, record->row, 1);
+        if (!ecs_is_alive(world, entity)) {
+            return;
+        }
+    }
+    ecs_sparseset_remove(component_record->sparse, entity.index);
+}
+
+// Adds the component if needed; the value is written in place.
+void ecs_world_sparse_set(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component, const void *value) {
+    ecs_component_record_t *component_record = ecs_component_get_record(world, component);
+
+    ecs_world_sparse_add(world, entity, component, component_record);
+    void *dest = ecs_sparseset_get(component_record->sparse, entity.index);
+    if (!dest) {
+        return; // an add hook removed it again
+    }
+    memcpy(dest, value, component_record->size);
+    if (component_record->on_set) {
+        ecs_entity_record_t *record = ecs_world_get_record(world, entity);
+        ecs_world_invoke_hook(world, component_record->on_set, component, record->archetype_id, record->row, 1);
+    }
+}
+
+// Keeps `component` in a sparse set of its own instead of table columns, for
+// components toggled often enough that moving rows costs more than the
+// per-entity lookup queries pay for it. Must be called before the component
+// is added to any entity.
+void ecs_set_component_sparse(ecs_world_t *world, ecs_entity_t component) {
+    ecs_component_record_t *component_record = ecs_component_get_record(world, component);
+
+    if (component_record->sparse) {
+        return;
+    }
+    ecs_component_storage_set_sparse(&world->component_storage, component);
+    ecs_vec_push(&world->sparse_components, &component);
+}
+
 void ecs_add(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component) {
+    if (ECS_UNLIKELY(world->defer_depth)) {
+        ecs_command_buffer_push(ecs_defer_stage(world), EcsCommandAdd, entity, component, NULL, 0);
+        return;
+    }
     ecs_entity_record_t *record = ecs_world_get_record(world, entity);
     ecs_archetype_t *archetype = ecs_world_get_archetype(world, record->archetype_id);
 
     if (ECS_UNLIKELY(ecs_archetype_has_component(archetype, component))) {
         return;
     }
+    ecs_component_record_t *component_record = ecs_component_get_record(world, component);
+    if (ECS_UNLIKELY(component_record && component_record->sparse)) {
+        ecs_world_sparse_add(world, entity, component, component_record);
+        return;
+    }
 
-    ecs_archetype_id_t *cached_archetype = ((ecs_archetype_id_t *) ecs_sparseset_get(&archetype->add_edge, component.value));
-    ecs_archetype_id_t new_archetype_id = 0;
+    ecs_archetype_id_t new_archetype_id = ecs_world_edge_add(world, record->archetype_id, component);
 
-    if (cached_archetype == NULL) {
-        ecs_type_t *type = ecs_type_from_other_add_temp(&archetype->type, component);
+    ecs_world_migrate_entity(world, entity, record, new_archetype_id);
 
-        new_archetype_id = ecs_archetype_get_or_create(world, type);
-        // refresh because the archetype may have reallocated
-        archetype = ecs_world_get_archetype(world, record->archetype_id);
-        ecs_sparseset_insert(&archetype->add_edge, component.value, &new_archetype_id);
-        ecs_sparseset_insert(&ecs_world_get_archetype(world, new_archetype_id)->remove_edge, component.value, &record->archetype_id);
-    } else {
-        new_archetype_id = *cached_archetype;
+    if (component_record && component_record->on_add) {
+        ecs_world_invoke_hook(world, component_record->on_add, component, record->archetype_id, record->row, 1);
+    }
+}
+
+// Creates `count` entities directly in the archetype of `type`. `values`, if
+// not NULL, holds one source array of `count` elements per component of
+// `type` (in the same order); NULL entries leave the component zeroed.
+void ecs_bulk_new(
+    ecs_world_t *world,
+    ecs_type_t *type,
+    uint32_t count,
+    ecs_entity_t *out_ids,
+    const void **values
+) {
+    if (count == 0) {
+        return;
     }
 
+    ecs_entity_t *components = type->data;
+    // sparse components stay out of the table, like with ecs_add
+    ecs_type_t sorted = ecs_vec_create(sizeof(ecs_entity_t));
+    for (uint32_t c = 0; c < type->count; c++) {
+        if (!ecs_world_sparse_storage(world, components[c])) {
+            ecs_vec_push(&sorted, &components[c]);
+        }
+    }
+    ecs_type_sort(&sorted);
+    ecs_archetype_id_t archetype_id = ecs_archetype_get_or_create(world, &sorted);
+    ecs_vec_free(&sorted);
 
-    ecs_world_migrate_entity(world, entity, record, new_archetype_id);
+    ecs_entity_t *entities = out_ids ? out_ids : malloc(count * sizeof(ecs_entity_t));
+    for (uint32_t i = 0; i < count; i++) {
+        entities[i] = ecs_entity_manager_new(&world->entity_manager);
+    }
 
-    ecs_component_record_t *component_record = ecs_component_get_record(world, component);
-    if (component_record && component_record->add_hook) {
-        component_record->add_hook(world, entity);
+    ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+    uint32_t row = ecs_archetype_add_entities(archetype, entities, count);
+
+    if (row == 0) {
+        ecs_query_archetype_set_active(world, archetype_id, true);
+    }
+    ecs_archetype_touch(archetype, ecs_world_write_tick(world));
+    for (uint32_t i = 0; i < count; i++) {
+        ecs_entity_record_t *record = ecs_world_get_record(world, entities[i]);
+        record->archetype_id = archetype_id;
+        record->row = row + i;
+    }
+
+    for (uint32_t c = 0; c < type->count; c++) {
+        ecs_sparseset_t *sparse = ecs_world_sparse_storage(world, components[c]);
+        ecs_column_t *column = ecs_sparseset_get(&archetype->rows, components[c].value);
+
+        if (sparse) {
+            ecs_component_record_t *component_record = ecs_component_get_record(world, components[c]);
+            size_t size = component_record->size;
+            for (uint32_t i = 0; i < count; i++) {
+                void *dest = ecs_sparseset_ensure(sparse, entities[i].index);
+                if (values && values[c]) {
+                    memcpy(dest, (const char *) values[c] + i * size, size);
+                }
+            }
+        } else if (values && values[c] && column) {
+            ecs_archetype_column_write(archetype, column, row, count, values[c]);
+        }
+    }
+
+    // the new rows stay in place until every hook has seen them
+    ecs_defer_begin(world);
+    for (uint32_t c = 0; c < type->count; c++) {
+        ecs_component_record_t *component_record = ecs_component_get_record(world, components[c]);
+        if (!component_record) {
+            continue;
+        }
+        // a sparse value is looked up per entity, so its hooks see one row at a time
+        uint32_t step = component_record->sparse ? 1 : count;
+        for (uint32_t i = 0; i < count; i += step) {
+            if (component_record->on_add) {
+                ecs_world_invoke_hook(world, component_record->on_add, components[c], archetype_id, row + i, step);
+            }
+            if (values && values[c] && component_record->on_set) {
+                ecs_world_invoke_hook(world, component_record->on_set, components[c], archetype_id, row + i, step);
+            }
+        }
+    }
+    ecs_defer_end(world);
+
+    if (!out_ids) {
+        free(entities);
     }
 }
 
 void ecs_add_hook(ecs_world_t *world, ecs_entity_t component, ecs_component_hook_call call) {
     ecs_component_record_t *component_record = ecs_component_get_record(world, component);
-    component_record->add_hook = call;
+    component_record->on_add = call;
 }
 
 void ecs_remove_hook(ecs_world_t *world, ecs_entity_t component, ecs_component_hook_call call) {
     ecs_component_record_t *component_record = ecs_component_get_record(world, component);
-    component_record->remove_hook = call;
+    component_record->on_remove = call;
 }
 
 void ecs_set_hook(ecs_world_t *world, ecs_entity_t component, ecs_component_hook_call call) {
     ecs_component_record_t *component_record = ecs_component_get_record(world, component);
-    component_record->set_hook = call;
+    component_record->on_set = call;
 }
 
-void ecs_remove(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component) {
+// Calls `hook` on rows [row, row + count) of a table, once per chunk so that
+// fields are plain arrays. Structural changes made by the hook are deferred
+// until it returns, which keeps the rows in place while it runs. A sparse
+// component is only ever hooked for one row, its field is that row's value.
+void ecs_world_invoke_hook(
+    ecs_world_t *world,
+    ecs_component_hook_call hook,
+    ecs_entity_t component,
+    ecs_archetype_id_t archetype_id,
+    uint32_t row,
+    uint32_t count
+) {
+    ecs_query_t query = { .terms = { { .id = component, .oper = EcsQueryOperEqual } } };
+
+    ecs_defer_begin(world);
+    while (count) {
+        ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+        ecs_column_t *column = ecs_sparseset_get(&archetype->rows, component.value);
+        uint32_t chunk_left = archetype->chunk_capacity - row % archetype->chunk_capacity;
+        ecs_iter_t it = {
+            .world = world,
+            .query = &query,
+            .archetype_p = archetype,
+            .current_archetype = -1,
+            .current_chunk = row / archetype->chunk_capacity,
+            .ids = &component,
+            .offset = row,
+            .count = count < chunk_left ? count : chunk_left,
+            .columns = { column ? ecs_archetype_column_row(archetype, column, row) : NULL },
+        };
+
+        if (!column) {
+            it.columns[0] = ecs_get(world, *ECS_VEC_GET(ecs_entity_t, &archetype->entities, row), component);
+        }
+
+        hook(&it);
+        row += it.count;
+        count -= it.count;
+    }
+    ecs_defer_end(world);
+}
+
+// Single entity form; skipped when the entity lost the component meanwhile.
+void ecs_world_entity_hook(ecs_world_t *world, ecs_component_hook_call hook, ecs_entity_t component, ecs_entity_t entity) {
+    if (!ecs_is_alive(world, entity) || !ecs_has(world, entity, component)) {
+        return;
+    }
     ecs_entity_record_t *record = ecs_world_get_record(world, entity);
-    ecs_archetype_t *archetype = ecs_world_get_archetype(world, record->archetype_id);
 
-    ecs_archetype_id_t *cached_archetype = ((ecs_archetype_id_t *) ecs_sparseset_get(&archetype->remove_edge, component.value));
-    ecs_archetype_id_t new_archetype_id = 0;
+    ecs_world_invoke_hook(world, hook, component, record->archetype_id, record->row, 1);
+}
 
-    if (cached_archetype == NULL) {
-        ecs_type_t *type = ecs_type_from_other_remove_temp(&archetype->type, component);
-        new_archetype_id = ecs_archetype_get_or_create(world, type);
-        // refresh because the archetype may have reallocated
-        archetype = ecs_world_get_archetype(world, record->archetype_id);
-        ecs_sparseset_insert(&archetype->remove_edge, component.value, &new_archetype_id);
-        ecs_sparseset_insert(&ecs_world_get_archetype(world, new_archetype_id)->add_edge, component.value, &record->archetype_id);
-    } else {
-        new_archetype_id = *cached_archetype;
+void ecs_remove(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component) {
+    if (ECS_UNLIKELY(world->defer_depth)) {
+        ecs_command_buffer_push(ecs_defer_stage(world), EcsCommandRemove, entity, component, NULL, 0);
+        return;
     }
+    ecs_entity_record_t *record = ecs_world_get_record(world, entity);
+    ecs_component_record_t *component_record = ecs_component_get_record(world, component);
+
+    if (ECS_UNLIKELY(!ecs_archetype_has_component(ecs_world_get_archetype(world, record->archetype_id), component))) {
+        if (component_record && component_record->sparse) {
+            ecs_world_sparse_remove(world, entity, component, component_record);
+        }
+        return;
+    }
+    if (component_record && component_record->on_remove) {
+        ecs_world_invoke_hook(world, component_record->on_remove, component, record->archetype_id, record->row, 1);
+        // the hook's own changes are applied by now
+        if (!ecs_is_alive(world, entity) || !ecs_has(world, entity, component)) {
+            return;
+        }
+    }
+    ecs_archetype_id_t new_archetype_id = ecs_world_edge_remove(world, record->archetype_id, component);
 
     ecs_world_migrate_entity(world, entity, record, new_archetype_id);
+}
+
+// Moves every row of `src_id` into `dest_id` at once and patches the moved
+// entity records in one linear pass.
+static void ecs_world_move_table(ecs_world_t *world, ecs_archetype_id_t src_id, ecs_archetype_id_t dest_id) {
+    ecs_archetype_t *src = ecs_world_get_archetype(world, src_id);
+    ecs_archetype_t *dest = ecs_world_get_archetype(world, dest_id);
+    uint32_t count = src->entities.count;
+
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t dest_row = ecs_archetype_move_entities(src, dest);
+    ecs_entity_t *entities = ECS_VEC_GET(ecs_entity_t, &dest->entities, dest_row);
+
+    ecs_world_archetype_emptied(world, src_id);
+    if (dest_row == 0) {
+        ecs_query_archetype_set_active(world, dest_id, true);
+    }
+    ecs_archetype_touch(dest, ecs_world_write_tick(world));
+    for (uint32_t i = 0; i < count; i++) {
+        ecs_entity_record_t *record = ecs_world_get_record(world, entities[i]);
+        record->archetype_id = dest_id;
+        record->row = dest_row + i;
+    }
+}
+
+// Sparse components and terms are decided row by row, so there is no whole
+// table to move: the matched entities are collected, then changed one by one.
+static void ecs_world_bulk_move_rows(ecs_world_t *world, ecs_query_t *query, ecs_entity_t component, bool add) {
+    ecs_vec_t entities = ecs_vec_create(sizeof(ecs_entity_t));
+    ecs_iter_t it = ecs_query(world, query);
+
+    while (ecs_iter_next(&it)) {
+        ecs_vec_push_batch(&entities, &ecs_it_entity(&it, 0), it.count);
+    }
+    iter_vec(ecs_entity_t, &entities) {
+        if (!ecs_is_alive(world, iter_value)) {
+            continue;
+        }
+        if (add) {
+            ecs_add(world, iter_value, component);
+        } else {
+            ecs_remove(world, iter_value, component);
+        }
+    }
+    ecs_vec_free(&entities);
+}
+
+static void ecs_world_bulk_move(
+    ecs_world_t *world,
+    ecs_query_t *query,
+    ecs_entity_t component,
+    bool add
+) {
     ecs_component_record_t *component_record = ecs_component_get_record(world, component);
-    if (component_record && component_record->remove_hook) {
-        component_record->remove_hook(world, entity);
+
+    if (ECS_UNLIKELY((component_record && component_record->sparse) || ecs_query_has_sparse_terms(world, query))) {
+        ecs_world_bulk_move_rows(world, query, component, add);
+        return;
+    }
+    ecs_vec_t matches = ecs_vec_create(sizeof(ecs_archetype_id_t));
+    ecs_component_hook_call hook = NULL;
+
+    if (component_record) {
+        hook = add ? component_record->on_add : component_record->on_remove;
+    }
+    ecs_query_match_archetypes(world, query, &matches);
+
+    ecs_archetype_id_t *ids = matches.data;
+    for (uint32_t i = 0; i < matches.count; i++) {
+        ecs_archetype_t *archetype = ecs_world_get_archetype(world, ids[i]);
+
+        if (archetype->entities.count == 0 || ecs_archetype_has_component(archetype, component) == add) {
+            continue;
+        }
+        ecs_archetype_id_t dest_id = add
+            ? ecs_world_edge_add(world, ids[i], component)
+            : ecs_world_edge_remove(world, ids[i], component);
+        ecs_archetype_t *dest = ecs_world_get_archetype(world, dest_id);
+        uint32_t dest_row = dest->entities.count;
+        uint32_t count = ecs_world_get_archetype(world, ids[i])->entities.count;
+
+        // remove hooks still see the component, add hooks see the moved rows
+        if (hook && !add) {
+            ecs_world_invoke_hook(world, hook, component, ids[i], 0, count);
+        }
+        ecs_world_move_table(world, ids[i], dest_id);
+        if (hook && add) {
+            ecs_world_invoke_hook(world, hook, component, dest_id, dest_row, count);
+        }
+    }
+    ecs_vec_free(&matches);
+}
+
+void ecs_bulk_add(ecs_world_t *world, ecs_query_t *query, ecs_entity_t component) {
+    ecs_world_bulk_move(world, query, component, true);
+}
+
+void ecs_bulk_remove(ecs_world_t *world, ecs_query_t *query, ecs_entity_t component) {
+    ecs_world_bulk_move(world, query, component, false);
+}
+
+// Phase membership and ordering live in pairs, which have no hooks.
+static void ecs_world_pipeline_pair_changed(ecs_world_t *world, ecs_entity_t relation) {
+    if (relation.value == ecs_id(EcsPhase).value
+        || relation.value == ecs_id(EcsDependsOn).value
+        || relation.value == ecs_id(EcsEnables).value) {
+        ecs_pipeline_invalidate(world);
     }
 }
 
 void ecs_add_pair(ecs_world_t *world, ecs_entity_t source, ecs_entity_t relation, ecs_entity_t target) {
-    ecs_add(world, source,
-        ecs_make_pair(relation, target)
-    );
-    ecs_add(world, source,
-        ecs_make_pair(relation, ecs_id(EcsWildcard))
-    );
+    ecs_world_pipeline_pair_changed(world, relation);
+    if (relation.value == ecs_id(EcsPhase).value) {
+        ecs_pipeline_phase_order(world, target);
+    }
+    ecs_add(world, source, ecs_make_pair(relation, target));
 }
 
 void ecs_remove_pair(ecs_world_t *world, ecs_entity_t source, ecs_entity_t relation, ecs_entity_t target) {
+    ecs_world_pipeline_pair_changed(world, relation);
     ecs_remove(world, source, ecs_make_pair(relation, target));
+}
 
-    ecs_type_t *type = &ecs_world_get_entity_archetype(world, source)->type;
+bool ecs_is_alive(ecs_world_t *world, ecs_entity_t entity) {
+    return ecs_entity_manager_is_alive(&world->entity_manager, entity);
+}
 
-    iter_vec(ecs_entity_t, type) {
-        if (iter_value.index == relation.index && iter_value.relation.target != ecs_id(EcsWildcard).index) {
-            return;
+static void ecs_world_fire_remove_hooks(ecs_world_t *world, ecs_entity_t entity) {
+    ecs_entity_record_t *record = ecs_world_get_record(world, entity);
+    const ecs_type_info_t *type = ecs_world_get_archetype(world, record->archetype_id)->type;
+
+    // the entity keeps its row until every hook has run
+    ecs_defer_begin(world);
+    iter_vec(ecs_entity_t, &type->ids) {
+        ecs_component_record_t *component_record = ecs_component_get_record(world, iter_value);
+        if (component_record && component_record->on_remove) {
+            ecs_world_invoke_hook(world, component_record->on_remove, iter_value, record->archetype_id, record->row, 1);
+        }
+    }
+    for (uint32_t i = 0; i < world->sparse_components.count; i++) {
+        ecs_entity_t component = *ECS_VEC_GET(ecs_entity_t, &world->sparse_components, i);
+        ecs_component_record_t *component_record = ecs_component_get_record(world, component);
+        if (component_record->on_remove && ecs_sparseset_exists(component_record->sparse, entity.index)) {
+            ecs_world_invoke_hook(world, component_record->on_remove, component, record->archetype_id, record->row, 1);
         }
     }
-    ecs_remove(world, source, ecs_make_pair(relation, ecs_id(EcsWildcard)));
+    ecs_defer_end(world);
 }
 
-bool ecs_is_alive(ecs_world_t *world, ecs_entity_t entity) {
-    return ecs_entity_manager_is_alive(&world->entity_manager, entity);
+// A recycled index must not find the values of the entity it replaces.
+static void ecs_world_sparse_clear(ecs_world_t *world, ecs_entity_t entity) {
+    iter_vec(ecs_entity_t, &world->sparse_components) {
+        ecs_sparseset_remove(ecs_world_sparse_storage(world, iter_value), entity.index);
+    }
+}
+
+// Pairs don't carry the target generation, so a dead target must not be left
+// in any pair: its children (ChildOf) are deleted with it, and every other
+// relation to it is removed from its sources. Only tables holding such a
+// pair are visited.
+static void ecs_world_cleanup_target(ecs_world_t *world, uint32_t target) {
+    ecs_vec_t *indexed = ecs_sparseset_get(&world->target_pairs, target);
+
+    if (!indexed) {
+        return;
+    }
+    ecs_vec_t pairs;
+    ecs_vec_t children = ecs_vec_create(sizeof(ecs_entity_t));
+
+    // the index stays: a recycled target index reuses the same pairs
+    ecs_vec_copy(indexed, &pairs);
+    iter_vec(ecs_entity_t, &pairs) {
+        ecs_entity_t pair = iter_value;
+        ecs_vec_t tables;
+
+        // moving rows may create tables, which grows the list
+        ecs_vec_copy(ecs_sparseset_get(&world->component_archetypes, pair.value), &tables);
+        for (uint32_t i = 0; i < tables.count; i++) {
+            ecs_archetype_id_t archetype_id = *ECS_VEC_GET(ecs_archetype_id_t, &tables, i);
+            ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+
+            if (!ecs_archetype_is_alive(archetype) || archetype->entities.count == 0) {
+                continue;
+            }
+            if (pair.relation.relation == ecs_id(EcsChildOf).index) {
+                ecs_vec_push_batch(&children, archetype->entities.data, archetype->entities.count);
+                continue;
+            }
+            ecs_world_move_table(world, archetype_id, ecs_world_edge_remove(world, archetype_id, pair));
+        }
+        ecs_vec_free(&tables);
+    }
+    ecs_vec_free(&pairs);
+    if (children.count) {
+        ecs_delete_batch(world, children.data, children.count);
+    }
+    ecs_vec_free(&children);
+}
+
+static void ecs_world_delete_row(ecs_world_t *world, ecs_archetype_id_t archetype_id, uint32_t row) {
+    ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+
+    ecs_world_handle_archetype_remove(world, ecs_archetype_remove_entity(archetype, row));
+    if (archetype->entities.count == 0) {
+        ecs_world_archetype_emptied(world, archetype_id);
+    }
 }
 
 void ecs_kill(ecs_world_t *world, ecs_entity_t entity) {
+    if (ECS_UNLIKELY(world->defer_depth)) {
+        ecs_command_buffer_push(ecs_defer_stage(world), EcsCommandKill, entity, (ecs_entity_t) { .value = 0 }, NULL, 0);
+        return;
+    }
+    if (!ecs_is_alive(world, entity)) {
+        return;
+    }
+    ecs_world_fire_remove_hooks(world, entity);
+    if (!ecs_is_alive(world, entity)) {
+        return;
+    }
+
     ecs_entity_record_t *record = ECS_GET_RECORD(world, entity);
-    ecs_archetype_remove_entity(ecs_world_get_archetype(world, record->archetype_id), record->row);
+    ecs_world_delete_row(world, record->archetype_id, record->row);
+    ecs_world_sparse_clear(world, entity);
     ecs_entity_manager_kill(&world->entity_manager, entity.index);
+    ecs_world_cleanup_target(world, entity.index);
+}
+
+typedef struct {
+    ecs_archetype_id_t archetype_id;
+    uint32_t row;
+    ecs_entity_t entity;
+} ecs_delete_entry_t;
+
+static int ecs_delete_entry_compare_entity(const void *a, const void *b) {
+    const ecs_delete_entry_t *left = a;
+    const ecs_delete_entry_t *right = b;
+
+    return (left->entity.value > right->entity.value) - (left->entity.value < right->entity.value);
+}
+
+// By table, then by descending row.
+static int ecs_delete_entry_compare_row(const void *a, const void *b) {
+    const ecs_delete_entry_t *left = a;
+    const ecs_delete_entry_t *right = b;
+
+    if (left->archetype_id != right->archetype_id) {
+        return left->archetype_id < right->archetype_id ? -1 : 1;
+    }
+    return (left->row < right->row) - (left->row > right->row);
+}
+
+// Deletes `count` entities at once. Remove hooks run first; rows are then
+// grouped by table and removed from the highest row down, so the row moved
+// into each hole is never one that is still waiting to be deleted.
+void ecs_delete_batch(ecs_world_t *world, const ecs_entity_t *entities, uint32_t count) {
+    if (ECS_UNLIKELY(world->defer_depth)) {
+        for (uint32_t i = 0; i < count; i++) {
+            ecs_command_buffer_push(ecs_defer_stage(world), EcsCommandKill, entities[i], (ecs_entity_t) { .value = 0 }, NULL, 0);
+        }
+        return;
+    }
+    ecs_delete_entry_t *entries = malloc(count * sizeof(ecs_delete_entry_t));
+    uint32_t entry_count = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].entity = entities[i];
+    }
+    qsort(entries, count, sizeof(ecs_delete_entry_t), ecs_delete_entry_compare_entity);
+    for (uint32_t i = 0; i < count; i++) {
+        if (ecs_is_alive(world, entries[i].entity) && (i == 0 || entries[i].entity.value != entries[i - 1].entity.value)) {
+            entries[entry_count++] = entries[i];
+        }
+    }
+
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if (ecs_is_alive(world, entries[i].entity)) {
+            ecs_world_fire_remove_hooks(world, entries[i].entity);
+        }
+    }
+    // hooks may have moved or killed some of them
+    uint32_t alive_count = 0;
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if (ecs_is_alive(world, entries[i].entity)) {
+            ecs_entity_record_t *record = ecs_world_get_record(world, entries[i].entity);
+            entries[i].archetype_id = record->archetype_id;
+            entries[i].row = record->row;
+            entries[alive_count++] = entries[i];
+        }
+    }
+    qsort(entries, alive_count, sizeof(ecs_delete_entry_t), ecs_delete_entry_compare_row);
+
+    for (uint32_t i = 0; i < alive_count; i++) {
+        ecs_world_delete_row(world, entries[i].archetype_id, entries[i].row);
+        ecs_world_sparse_clear(world, entries[i].entity);
+        ecs_entity_manager_kill(&world->entity_manager, entries[i].entity.index);
+    }
+    // after every row is gone, as cleanup moves rows of other tables
+    for (uint32_t i = 0; i < alive_count; i++) {
+        ecs_world_cleanup_target(world, entries[i].entity.index);
+    }
+    free(entries);
+}
+
+// Queues `entity` for deletion at the end of the current ecs_progress.
+void ecs_kill_deferred(ecs_world_t *world, ecs_entity_t entity) {
+    ecs_vec_push(&world->kill_queue, &entity);
+}
+
+void ecs_world_flush_kills(ecs_world_t *world) {
+    while (world->kill_queue.count) {
+        // hooks may queue more kills while the batch runs
+        ecs_vec_t queue = world->kill_queue;
+
+        ecs_vec_init(&world->kill_queue, sizeof(ecs_entity_t));
+        ecs_delete_batch(world, queue.data, queue.count);
+        ecs_vec_free(&queue);
+    }
+}
+
+static void ecs_world_unlink_edges(ecs_world_t *world, ecs_archetype_id_t archetype_id, bool add) {
+    ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+    ecs_smallmap_t *edges = add ? &archetype->add_edge : &archetype->remove_edge;
+    uint64_t component;
+    ecs_archetype_id_t target;
+
+    for (uint32_t i = 0; i < ecs_smallmap_slot_count(edges); i++) {
+        if (ecs_smallmap_slot(edges, i, &component, &target)) {
+            ecs_archetype_t *neighbour = ecs_world_get_archetype(world, target);
+            ecs_smallmap_remove(add ? &neighbour->remove_edge : &neighbour->add_edge, component);
+        }
+    }
+}
+
+static void ecs_world_unindex_archetype(ecs_world_t *world, ecs_entity_t component, ecs_archetype_id_t archetype_id) {
+    ecs_vec_t *archetypes = ecs_sparseset_get(&world->component_archetypes, component.value);
+    ecs_archetype_id_t *ids = archetypes->data;
+
+    for (uint32_t i = 0; i < archetypes->count; i++) {
+        if (ids[i] == archetype_id) {
+            ecs_vec_remove_fast(archetypes, i);
+            return;
+        }
+    }
+}
+
+static void ecs_world_reclaim_archetype(ecs_world_t *world, ecs_archetype_id_t archetype_id) {
+    ecs_archetype_t *archetype = ecs_world_get_archetype(world, archetype_id);
+    ecs_archetype_probe_t probe = { .world = world, .type = archetype->type };
+
+    ecs_world_unlink_edges(world, archetype_id, true);
+    ecs_world_unlink_edges(world, archetype_id, false);
+    ecs_query_archetype_remove(world, archetype_id);
+
+    iter_vec(ecs_entity_t, &archetype->type->ids) {
+        ecs_world_unindex_archetype(world, iter_value, archetype_id);
+        if (ecs_is_pair(iter_value) && !ecs_world_same_relation(archetype->type, __index - 1, iter_value)) {
+            ecs_world_unindex_archetype(world, ecs_world_wildcard_of(iter_value), archetype_id);
+        }
+    }
+
+    ecs_hashmap_remove(&world->archetype_map, archetype->type->hash, ecs_archetype_type_equals, &probe);
+    ecs_archetype_fini(archetype);
+    archetype->type = NULL;
+    ecs_vec_push(&world->free_archetype_ids, &archetype_id);
+}
+
+// Frees every table (but the root) that has been empty for at least
+// `policy.empty_frames` frames. Must not run while a query is iterated.
+uint32_t ecs_world_gc(ecs_world_t *world, ecs_gc_policy_t policy) {
+    uint32_t reclaimed = 0;
+
+    for (ecs_archetype_id_t id = 1; id < world->archetypes.count; id++) {
+        ecs_archetype_t *archetype = ecs_world_get_archetype(world, id);
+
+        if (!ecs_archetype_is_alive(archetype) || archetype->entities.count
+            || world->frame_count - archetype->empty_since < policy.empty_frames) {
+            continue;
+        }
+        ecs_world_reclaim_archetype(world, id);
+        reclaimed++;
+    }
+    return reclaimed;
 }
@@ -1,13 +1,18 @@
 #ifndef ECS_WORLD_H
     #define ECS_WORLD_H
     #include "ecs_archetype.h"
+    #include "ecs_chunk_pool.h"
+    #include "ecs_command.h"
     #include "ecs_component_storage.h"
     #include "ecs_config.h"
     #include "ecs_entity.h"
+    #include "ecs_pipeline.h"
     #include "ecs_query.h"
     #include "ecs_sparseset.h"
+    #include "ecs_type_table.h"
     #include "ecs_types.h"
     #include "ecs_vec.h"
+    #include "ecs_worker.h"
     #include "ecs_map.h"
     #include "ecs_bootstrap.h"
     #include "ecs_strmap.h"
@@ -15,7 +20,7 @@
     #include <stddef.h>
     #define ecs_world_get_archetype_by_id(world, archetype_id) ECS_VEC_GET(ecs_archetype_t, &world->archetypes, archetype_id)
     #define ecs_world_get_entity_archetype(world, entity) ecs_world_get_archetype(world, ecs_world_get_record(world, entity)->archetype_id)
-    #define ecs_world_get_record_by_index(world, index) ECS_VEC_GET(ecs_entity_record_t, &world->entity_manager.entity_record, index)
+    #define ecs_world_get_record_by_index(world, index) ecs_entity_manager_record(&(world)->entity_manager, index)
     #define ecs_world_get_record(world, entity) ecs_world_get_record_by_index(world, entity.index)
     #define ecs_world_get_default_archetype(world) ECS_VEC_GET(ecs_archetype_t, &world->archetypes, 0)
     #define ecs_singleton(world, entity) ecs_add(world, entity, entity)
@@ -26,17 +31,32 @@
 typedef struct ecs_world_t {
     ecs_entity_manager_t entity_manager;
     ecs_vec_t archetypes;
-    ecs_hashmap_t archetype_map;
+    ecs_vec_t free_archetype_ids; // ecs_archetype_id_t, reclaimed by ecs_world_gc
+    uint64_t frame_count;
+    uint32_t change_tick; // advanced once per system run, and by writes once a cursor has seen it
+    bool tick_seen; // a cursor recorded the current write tick
+    ecs_vec_t kill_queue; // ecs_entity_t, flushed at the end of ecs_progress
+    int32_t defer_depth;
+    ecs_command_buffer_t commands; // stage used outside of systems
+    ecs_vec_t system_stages; // ecs_command_buffer_t, one per system of the running phase
+    ecs_worker_pool_t workers; // runs non-conflicting systems of a phase concurrently
+    ecs_chunk_pool_t chunk_pool;
+    ecs_type_table_t type_table;
+    ecs_hashmap_t archetype_map; // type hash -> ecs_archetype_id_t
     ecs_component_storage_t component_storage;
     ecs_vec_t queries;
     ecs_strmap_t entity_map;
-    ecs_sparseset_t component_archetypes; // ecs_vec<ecs_archetype_id>
-
-    EcsQueryId OnPreUpdateQuery;
-    EcsQueryId OnUpdateQuery;
-    EcsQueryId OnPostUpdateQuery;
+    ecs_sparseset_t component_archetypes; // ecs_vec<ecs_archetype_id>, pairs included
+    ecs_sparseset_t target_pairs; // <target index, ecs_vec<ecs_entity_t>>, every (R, target) with a table
+    ecs_vec_t sparse_components; // ecs_entity_t, components stored outside of tables
+    ecs_sparseset_t cascade_versions; // <relation index, uint32_t>, for relations some query cascades on
+    ecs_pipeline_t pipeline;
 } ecs_world_t;
 
+typedef struct {
+    uint32_t empty_frames; // reclaim tables that stayed empty this many frames
+} ecs_gc_policy_t;
+
 typedef char* EcsName;
 
 ECS_COMPONENT_DECLARE(EcsName);
@@ -44,28 +64,55 @@ ECS_COMPONENT_DECLARE(EcsName);
 ecs_world_t *ecs_init(void);
 void ecs_add(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component);
 void ecs_remove(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component);
-ecs_archetype_id_t ecs_archetype_create(ecs_world_t *world, ecs_type_t *type);
+ecs_archetype_id_t ecs_archetype_create(ecs_world_t *world, const ecs_type_info_t *type);
+ecs_archetype_id_t ecs_archetype_for_type(ecs_world_t *world, const ecs_type_info_t *type);
+ecs_archetype_id_t ecs_archetype_get_or_create(ecs_world_t *world, ecs_type_t *type);
+void ecs_bulk_add(ecs_world_t *world, ecs_query_t *query, ecs_entity_t component);
+void ecs_bulk_remove(ecs_world_t *world, ecs_query_t *query, ecs_entity_t component);
+void ecs_bulk_new(ecs_world_t *world, ecs_type_t *type, uint32_t count, ecs_entity_t *out_ids, const void **values);
 void ecs_add_pair(ecs_world_t *world, ecs_entity_t source, ecs_entity_t relation, ecs_entity_t target) ;
 void ecs_remove_pair(ecs_world_t *world, ecs_entity_t source, ecs_entity_t relation, ecs_entity_t target);
 void ecs_remove_hook(ecs_world_t *world, ecs_entity_t component, ecs_component_hook_call call);
 void ecs_add_hook(ecs_world_t *world, ecs_entity_t component, ecs_component_hook_call call);
 void ecs_set_hook(ecs_world_t *world, ecs_entity_t component, ecs_component_hook_call call);
+void ecs_set_component_sparse(ecs_world_t *world, ecs_entity_t component);
+void ecs_world_sparse_set(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component, const void *value);
+const ecs_vec_t *ecs_pair_archetypes(ecs_world_t *world, ecs_entity_t relation, ecs_entity_t target);
 bool ecs_is_alive(ecs_world_t *world, ecs_entity_t entity);
 void ecs_kill(ecs_world_t *world, ecs_entity_t entity);
+void ecs_kill_deferred(ecs_world_t *world, ecs_entity_t entity);
+void ecs_delete_batch(ecs_world_t *world, const ecs_entity_t *entities, uint32_t count);
+void ecs_world_flush_kills(ecs_world_t *world);
+uint32_t ecs_world_gc(ecs_world_t *world, ecs_gc_policy_t policy);
+ecs_archetype_id_t ecs_world_edge_add(ecs_world_t *world, ecs_archetype_id_t archetype_id, ecs_entity_t component);
+ecs_archetype_id_t ecs_world_edge_remove(ecs_world_t *world, ecs_archetype_id_t archetype_id, ecs_entity_t component);
+void ecs_world_move_entity(ecs_world_t *world, ecs_entity_t entity, ecs_archetype_id_t archetype_id);
+void ecs_world_invoke_hook(
+    ecs_world_t *world,
+    ecs_component_hook_call hook,
+    ecs_entity_t component,
+    ecs_archetype_id_t archetype_id,
+    uint32_t row,
+    uint32_t count
+);
+void ecs_world_entity_hook(ecs_world_t *world, ecs_component_hook_call hook, ecs_entity_t component, ecs_entity_t entity);
 void ecs_fini(ecs_world_t *world);
 
+// Tick stamped by writes made outside of a system run; every system that
+// runs afterwards sees them as changes. Once a cursor has recorded it, the
+// next write moves to a later one, so iterating alone never advances it.
 ECS_INLINE
-ecs_archetype_t *ecs_world_get_archetype(ecs_world_t *world, ecs_archetype_id_t id) {
-    return ECS_VEC_GET(ecs_archetype_t, &world->archetypes, id);
+uint32_t ecs_world_write_tick(ecs_world_t *world) {
+    if (ECS_UNLIKELY(world->tick_seen)) {
+        world->change_tick++;
+        world->tick_seen = false;
+    }
+    return world->change_tick + 1;
 }
 
 ECS_INLINE
-ecs_archetype_id_t ecs_archetype_get_or_create(ecs_world_t *world, ecs_type_t *type) {
-    uint64_t archetype_id;
-    if (ecs_hashmap_get(&world->archetype_map, type, &archetype_id)) {
-        return archetype_id;
-    }
-    return ecs_archetype_create(world, type);
+ecs_archetype_t *ecs_world_get_archetype(ecs_world_t *world, ecs_archetype_id_t id) {
+    return ECS_VEC_GET(ecs_archetype_t, &world->archetypes, id);
 }
 
 ECS_INLINE
@@ -73,7 +120,12 @@ ecs_entity_t ecs_new(ecs_world_t *world) {
     ecs_entity_t entity = ecs_entity_manager_new(&world->entity_manager);
 
     ecs_archetype_t *archetype = ecs_world_get_default_archetype(world);
-    ecs_archetype_add_entity(archetype, entity);
+    uint32_t row = ecs_archetype_add_entity(archetype, entity);
+
+    ecs_world_get_record(world, entity)->row = row;
+    if (row == 0) {
+        ecs_query_archetype_set_active(world, 0, true);
+    }
     return entity;
 }
 
@@ -94,30 +146,82 @@ void ecs_set_component_meta(ecs_world_t *world, ecs_entity_t component, size_t s
 }
 
 
+#define ECS_PAIR (1ULL << 63)
+#define ecs_is_pair(entity) (((entity).value & ECS_PAIR) != 0)
+#define ecs_is_wildcard_pair(entity) (ecs_is_pair(entity) && (entity).relation.target == ecs_id(EcsWildcard).index)
+#define ecs_pair_target(entity) (ecs_entity_t) { .index = (entity).relation.target, .gen = 0 }
+#define ecs_pair_relation(entity) (ecs_entity_t) { .index = (entity).relation.relation, .gen = 0 }
+
+// Set of `component` if it is stored outside of tables, NULL otherwise.
+ECS_INLINE
+ecs_sparseset_t *ecs_world_sparse_storage(ecs_world_t *world, ecs_entity_t component) {
+    ecs_component_record_t *component_record = ecs_component_get_record(world, component);
+
+    return component_record ? component_record->sparse : NULL;
+}
+
+// (R, *) is not stored in tables; it matches any pair of R. Sparse
+// components are only looked up once the table misses.
 ECS_INLINE
 bool ecs_has(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component) {
     ecs_entity_record_t *record = ecs_world_get_record(world, entity);
     ecs_archetype_t *archetype = ecs_world_get_archetype(world, record->archetype_id);
 
-    return ecs_archetype_has_component(archetype, component);
+    if (ECS_UNLIKELY(ecs_is_wildcard_pair(component))) {
+        return ecs_type_info_find_relation(archetype->type, component.relation.relation).value != 0;
+    }
+    if (ECS_LIKELY(ecs_archetype_has_component(archetype, component))) {
+        return true;
+    }
+    ecs_sparseset_t *sparse = ecs_world_sparse_storage(world, component);
+    return sparse && ecs_sparseset_exists(sparse, entity.index);
 }
 
 ECS_INLINE
 void *ecs_get(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component) {
     ecs_entity_record_t *record = ecs_world_get_record(world, entity);
     ecs_archetype_t *archetype = ecs_world_get_archetype(world, record->archetype_id);
+    void *value = ecs_archetype_get_component(archetype, record->row, component);
 
-    return ecs_archetype_get_component(archetype, record->row, component);
+    if (ECS_LIKELY(value != NULL)) {
+        return value;
+    }
+    ecs_sparseset_t *sparse = ecs_world_sparse_storage(world, component);
+    return sparse ? ecs_sparseset_get(sparse, entity.index) : NULL;
 }
 
 ECS_INLINE
 void ecs_set(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component, void *value) {
-    void *component_p = ecs_get(world, entity, component);
     ecs_component_record_t *component_record = ecs_component_get_record(world, component);
 
-    memcpy(component_p, value, component_record->size);
-    if (component_record != NULL && component_record->set_hook != NULL) {
-        component_record->set_hook(world, entity);
+    if (ECS_UNLIKELY(world->defer_depth)) {
+        ecs_command_buffer_push(ecs_defer_stage(world), EcsCommandSet, entity, component, value, component_record->size);
+        return;
+    }
+    if (ECS_UNLIKELY(component_record->sparse != NULL)) {
+        ecs_world_sparse_set(world, entity, component, value);
+        return;
+    }
+    ecs_entity_record_t *record = ecs_world_get_record(world, entity);
+    ecs_archetype_t *archetype = ecs_world_get_archetype(world, record->archetype_id);
+
+    // like a deferred set, a missing component is added first
+    if (ECS_UNLIKELY(!ecs_archetype_has_component(archetype, component))) {
+        ecs_add(world, entity, component);
+        if (!ecs_is_alive(world, entity) || !ecs_has(world, entity, component)) {
+            return; // an add hook removed it again
+        }
+        archetype = ecs_world_get_archetype(world, record->archetype_id);
+    }
+    ecs_column_t *column = ecs_sparseset_get(&archetype->rows, component.value);
+
+    // tags have nothing to write, only the hook runs
+    if (ECS_LIKELY(column != NULL)) {
+        memcpy(ecs_archetype_column_row(archetype, column, record->row), value, component_record->size);
+        column->change_tick = ecs_world_write_tick(world);
+    }
+    if (component_record->on_set != NULL) {
+        ecs_world_invoke_hook(world, component_record->on_set, component, record->archetype_id, record->row, 1);
     }
 }
 
@@ -127,20 +231,13 @@ void ecs_insert(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t component,
     ecs_set(world, entity, component, value);
 }
 
-#define ECS_PAIR 0x0000000000000001
-#define ecs_is_pair(entity) ((entity.flags & ECS_PAIR) == ECS_PAIR)
-#define ecs_pair_target(entity) (ecs_entity_t) { .index = entity.relation.target, .gen = 0 }
-#define ecs_pair_relation(entity) (ecs_entity_t) { .index = entity.relation.relation, .gen = 0 }
-
 ECS_INLINE
 ecs_entity_t ecs_make_pair(ecs_entity_t relation, ecs_entity_t target) {
-    ecs_entity_t pair = {
-        .relation = {
-            .relation = relation.index,
-            .target = target.index
-        },
-    };
-    pair.flags |= ECS_PAIR;
+    ecs_entity_t pair = { .value = 0 };
+
+    pair.relation.relation = relation.index;
+    pair.relation.target = target.index;
+    pair.relation.is_pair = 1;
     return pair;
 }
 
@@ -42,5 +42,51 @@ Test(obserer, simple) {
 
     ecs_observer_trigger(world, ecs_id(SysEvent), player);
 
-    cr_assert(sys_event_call_count == 3);
+    cr_assert(sys_event_call_count == 2);
+}
+
+static int health_event_rows = 0;
+void OnHealthEvent(ecs_world_t *world, ecs_entity_t entity, ecs_iter_t *it) {
+    (void) world;
+    cr_assert_eq(it->count, 1);
+    cr_assert_eq(ecs_it_entity(it, 0).value, entity.value);
+    health_event_rows += it->count;
+}
+
+Test(obserer, only_observers_matching_the_target_table_fire) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, SysEvent);
+
+    ecs_entity_t health = ecs_new(world);
+    ecs_entity_t armor = ecs_new(world);
+    ecs_entity_t knight = ecs_new(world);
+    ecs_add(world, knight, health);
+
+    ecs_query_t query = query({
+        .terms = {
+            { health, .oper = EcsQueryOperEqual },
+            { armor, .oper = EcsQueryOperNot }
+        }
+    });
+    ecs_observe(world, ecs_id(SysEvent), OnHealthEvent, &query);
+
+    ecs_entity_t squire = ecs_new(world);
+    ecs_add(world, squire, armor);
+    ecs_add(world, squire, health);
+    ecs_entity_t peasant = ecs_new(world);
+    // tables created after the observer pick it up as well
+    ecs_entity_t mage = ecs_new(world);
+    ecs_add(world, mage, health);
+    ecs_add(world, mage, ecs_new(world));
+
+    ecs_observer_trigger(world, ecs_id(SysEvent), squire);
+    ecs_observer_trigger(world, ecs_id(SysEvent), peasant);
+    cr_assert_eq(health_event_rows, 0);
+
+    ecs_remove(world, squire, armor);
+    ecs_observer_trigger(world, ecs_id(SysEvent), squire);
+    ecs_observer_trigger(world, ecs_id(SysEvent), knight);
+    ecs_observer_trigger(world, ecs_id(SysEvent), mage);
+    cr_assert_eq(health_event_rows, 3);
+    ecs_fini(world);
 }
@@ -0,0 +1,220 @@
+#include "ecs_archetype.h"
+#include "ecs_query.h"
+#include "ecs_system.h"
+#include "ecs_types.h"
+#include "test.h"
+#include <criterion/criterion.h>
+#include <ecs_world.h>
+#include <stdint.h>
+
+#define CHUNK_TEST_ENTITIES 10000
+
+Test(archetype, rows_span_multiple_chunks) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Health);
+
+    ecs_entity_t entities[CHUNK_TEST_ENTITIES];
+    for (int i = 0; i < CHUNK_TEST_ENTITIES; i++) {
+        entities[i] = ecs_new(world);
+        ecs_add(world, entities[i], ecs_id(Position));
+        ecs_add(world, entities[i], ecs_id(Health));
+        ecs_set(world, entities[i], ecs_id(Position), &(Position) {i, -i});
+        ecs_set(world, entities[i], ecs_id(Health), &(Health) {i * 2});
+    }
+
+    ecs_archetype_t *archetype = ecs_world_get_entity_archetype(world, entities[0]);
+    cr_assert(archetype->chunk_capacity < CHUNK_TEST_ENTITIES);
+    cr_assert(ecs_archetype_chunk_count(archetype) > 1);
+
+    for (int i = 0; i < CHUNK_TEST_ENTITIES; i++) {
+        Position *p = ecs_get(world, entities[i], ecs_id(Position));
+        Health *h = ecs_get(world, entities[i], ecs_id(Health));
+        cr_assert_eq(p->x, i);
+        cr_assert_eq(p->y, -i);
+        cr_assert_eq(h->value, i * 2);
+    }
+    ecs_fini(world);
+}
+
+Test(archetype, pointers_stay_valid_while_table_grows) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+
+    ecs_entity_t first = ecs_new(world);
+    ecs_add(world, first, ecs_id(Position));
+    ecs_set(world, first, ecs_id(Position), &(Position) {7, 8});
+    Position *p = ecs_get(world, first, ecs_id(Position));
+
+    for (int i = 0; i < CHUNK_TEST_ENTITIES; i++) {
+        ecs_add(world, ecs_new(world), ecs_id(Position));
+    }
+
+    cr_assert_eq(p, ecs_get(world, first, ecs_id(Position)));
+    cr_assert_eq(p->x, 7);
+    cr_assert_eq(p->y, 8);
+    ecs_fini(world);
+}
+
+Test(archetype, remove_moves_last_row_across_chunks) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Health);
+
+    ecs_entity_t entities[CHUNK_TEST_ENTITIES];
+    for (int i = 0; i < CHUNK_TEST_ENTITIES; i++) {
+        entities[i] = ecs_new(world);
+        ecs_add(world, entities[i], ecs_id(Position));
+        ecs_set(world, entities[i], ecs_id(Position), &(Position) {i, i});
+    }
+
+    ecs_add(world, entities[0], ecs_id(Health));
+
+    Position *last = ecs_get(world, entities[CHUNK_TEST_ENTITIES - 1], ecs_id(Position));
+    Position *moved = ecs_get(world, entities[0], ecs_id(Position));
+    cr_assert_eq(last->x, CHUNK_TEST_ENTITIES - 1);
+    cr_assert_eq(moved->x, 0);
+    cr_assert(ecs_has(world, entities[0], ecs_id(Health)));
+    ecs_fini(world);
+}
+
+static int chunk_rows_seen = 0;
+static int chunk_calls = 0;
+
+static void CountChunks(ecs_iter_t *it) {
+    Position *p = ecs_field(it, Position);
+
+    chunk_calls++;
+    for (int i = 0; i < it->count; i++) {
+        cr_assert_eq(ecs_it_entity(it, i).index, (uint32_t) p[i].x);
+        chunk_rows_seen++;
+    }
+}
+
+Test(archetype, iteration_visits_every_chunk) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+
+    for (int i = 0; i < CHUNK_TEST_ENTITIES; i++) {
+        ecs_entity_t e = ecs_new(world);
+        ecs_add(world, e, ecs_id(Position));
+        ecs_set(world, e, ecs_id(Position), &(Position) {e.index, 0});
+    }
+
+    ECS_SYSTEM(world, CountChunks, EcsOnUpdate, Position);
+    ecs_progress(world);
+
+    cr_assert_eq(chunk_rows_seen, CHUNK_TEST_ENTITIES);
+    cr_assert(chunk_calls > 1);
+    ecs_fini(world);
+}
+
+Test(archetype, edges_spill_past_inline_capacity) {
+    ecs_world_t *world = ecs_init();
+    ecs_entity_t components[32];
+    ecs_entity_t entities[32];
+
+    for (int i = 0; i < 32; i++) {
+        components[i] = ecs_new(world);
+        ecs_set_component_meta(world, components[i], sizeof(int));
+    }
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 32; i++) {
+            entities[i] = ecs_new(world);
+            ecs_add(world, entities[i], components[i]);
+            cr_assert(ecs_has(world, entities[i], components[i]));
+            ecs_remove(world, entities[i], components[i]);
+            cr_assert_not(ecs_has(world, entities[i], components[i]));
+        }
+    }
+
+    ecs_archetype_t *root = ecs_world_get_default_archetype(world);
+    cr_assert(root->add_edge.spill.count > 0);
+    for (int i = 0; i < 32; i++) {
+        ecs_archetype_id_t *target = ecs_smallmap_get(&root->add_edge, components[i].value);
+        cr_assert_not_null(target);
+        cr_assert(ecs_archetype_has_component(ecs_world_get_archetype(world, *target), components[i]));
+        cr_assert_eq(*ecs_smallmap_get(&ecs_world_get_archetype(world, *target)->remove_edge, components[i].value), 0);
+    }
+    ecs_fini(world);
+}
+
+Test(archetype, types_are_interned) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Health);
+
+    ecs_entity_t a = ecs_new(world);
+    ecs_add(world, a, ecs_id(Position));
+    ecs_add(world, a, ecs_id(Health));
+    ecs_entity_t b = ecs_new(world);
+    ecs_add(world, b, ecs_id(Health));
+    ecs_add(world, b, ecs_id(Position));
+
+    const ecs_type_info_t *type = ecs_world_get_entity_archetype(world, a)->type;
+    cr_assert_eq(type, ecs_world_get_entity_archetype(world, b)->type);
+    cr_assert(ecs_type_info_has(type, ecs_id(Position)));
+    cr_assert(ecs_type_info_has(type, ecs_id(Health)));
+    cr_assert_not(ecs_type_info_has(type, ecs_id(EcsName)));
+
+    ecs_type_t ids = ECS_VEC_RAW(ecs_entity_t, ecs_id(Position), ecs_id(Health));
+    ecs_type_sort(&ids);
+    cr_assert_eq(ecs_type_table_intern(&world->type_table, &ids), type);
+
+    size_t type_count = world->type_table.infos.count;
+    ecs_remove(world, a, ecs_id(EcsName));
+    cr_assert_eq(ecs_world_get_entity_archetype(world, a)->type, type);
+    cr_assert_eq(world->type_table.infos.count, type_count);
+    ecs_fini(world);
+}
+
+Test(archetype, tags_have_no_column) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Jump);
+
+    ecs_entity_t plain = ecs_new(world);
+    ecs_entity_t tagged = ecs_new(world);
+    ecs_insert(world, plain, ecs_id(Position), &(Position) {1, 2});
+    ecs_insert(world, tagged, ecs_id(Position), &(Position) {3, 4});
+    ecs_add(world, tagged, ecs_id(Jump));
+
+    ecs_archetype_t *with_tag = ecs_world_get_entity_archetype(world, tagged);
+    ecs_archetype_t *without_tag = ecs_world_get_entity_archetype(world, plain);
+    cr_assert(ecs_has(world, tagged, ecs_id(Jump)));
+    cr_assert_eq(with_tag->rows.dense.count, 1);
+    cr_assert_eq(with_tag->chunk_capacity, without_tag->chunk_capacity);
+    cr_assert_eq(((Position *) ecs_get(world, tagged, ecs_id(Position)))->x, 3);
+
+    ecs_iter_t it = ecs_query(world, &query({ .terms = { { .id = ecs_id(Position) }, { .id = ecs_id(Jump) } } }));
+    cr_assert(ecs_iter_next(&it));
+    cr_assert_eq(it.count, 1);
+    cr_assert_eq(ecs_field(&it, Position)->x, 3);
+    cr_assert_null(it.columns[1]);
+
+    ecs_remove(world, tagged, ecs_id(Jump));
+    cr_assert_not(ecs_has(world, tagged, ecs_id(Jump)));
+    cr_assert_eq(((Position *) ecs_get(world, tagged, ecs_id(Position)))->y, 4);
+
+    ecs_fini(world);
+}
+
+Test(archetype, new_tables_allocate_nothing) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Jump);
+
+    ecs_archetype_id_t root = ecs_world_get_record(world, ecs_new(world))->archetype_id;
+    ecs_archetype_t *tagged = ecs_world_get_archetype(world, ecs_world_edge_add(world, root, ecs_id(Jump)));
+    cr_assert_eq(tagged->rows.dense.capacity, 0);
+    cr_assert_eq(tagged->rows.dense_sparse_key.capacity, 0);
+    cr_assert_eq(tagged->entities.capacity, 0);
+    cr_assert_eq(tagged->chunks.capacity, 0);
+
+    ecs_archetype_t *positioned = ecs_world_get_archetype(world, ecs_world_edge_add(world, root, ecs_id(Position)));
+    cr_assert_eq(positioned->rows.dense.count, 1);
+    cr_assert_eq(positioned->entities.capacity, 0);
+    cr_assert_eq(positioned->chunks.capacity, 0);
+
+    ecs_fini(world);
+}
@@ -307,3 +307,38 @@ Test(dsl_parser, empty_query) {
     ecs_dsl_query_free(query);
     ecs_dsl_parser_free(&parser);
 }
+
+Test(dsl_parser, changed_filter) {
+    ecs_dsl_parser_t parser;
+    ecs_dsl_parser_init(&parser, "[in] Changed(Position), Changed, !Dead");
+
+    ecs_dsl_query_t *query = ecs_dsl_parser_parse(&parser);
+    cr_assert_not_null(query);
+    cr_assert_eq(query->count, 3);
+
+    cr_assert_eq(query->terms[0].changed, true);
+    cr_assert_eq(query->terms[0].access, ECS_DSL_ACCESS_IN);
+    cr_assert_str_eq(query->terms[0].id.first, "Position");
+    cr_assert_eq(query->terms[1].changed, false);
+    cr_assert_str_eq(query->terms[1].id.first, "Changed");
+    cr_assert_eq(query->terms[2].modifier, ECS_DSL_MOD_NOT);
+
+    ecs_dsl_query_free(query);
+    ecs_dsl_parser_free(&parser);
+}
+
+Test(dsl_parser, cascade_modifier) {
+    ecs_dsl_parser_t parser;
+    ecs_dsl_parser_init(&parser, "Position, cascade(ChildOf)");
+
+    ecs_dsl_query_t *query = ecs_dsl_parser_parse(&parser);
+    cr_assert_not_null(query);
+    cr_assert_eq(query->count, 2);
+
+    cr_assert_eq(query->terms[0].cascade, false);
+    cr_assert_eq(query->terms[1].cascade, true);
+    cr_assert_str_eq(query->terms[1].id.first, "ChildOf");
+
+    ecs_dsl_query_free(query);
+    ecs_dsl_parser_free(&parser);
+}
@@ -3,6 +3,7 @@
 #include "ecs_vec.h"
 #include "ecs_system.h"
 #include <assert.h>
+#include <stdatomic.h>
 #include <criterion/criterion.h>
 #include <ecs_world.h>
 #include <stdio.h>
@@ -76,3 +77,458 @@ Test(query, medium) {
     }
     cr_assert(count == 1);
 }
+
+static int jump_hook_calls = 0;
+static int jump_hook_batches = 0;
+
+static void OnAddJump(ecs_iter_t *it) {
+    jump_hook_calls += it->count;
+    jump_hook_batches++;
+}
+
+Test(query, bulk_add_and_remove_move_whole_tables) {
+    ecs_world_t *world = bootstrap();
+    ecs_entity_t with_health[3000];
+    ecs_entity_t without_health[100];
+
+    ecs_add_hook(world, ecs_id(Jump), OnAddJump);
+    for (int i = 0; i < 3000; i++) {
+        with_health[i] = ecs_new(world);
+        ecs_add(world, with_health[i], ecs_id(Position));
+        ecs_add(world, with_health[i], ecs_id(Health));
+        ecs_set(world, with_health[i], ecs_id(Position), &(Position) {i, -i});
+    }
+    for (int i = 0; i < 100; i++) {
+        without_health[i] = ecs_new(world);
+        ecs_add(world, without_health[i], ecs_id(Position));
+    }
+
+    ecs_query_t health_query = query({
+        .terms = {
+            { .id = ecs_id(Health), .oper = EcsQueryOperEqual },
+        },
+    });
+
+    ecs_bulk_add(world, &health_query, ecs_id(Jump));
+
+    cr_assert_eq(jump_hook_calls, 3000);
+    cr_assert(jump_hook_batches < 3000);
+    for (int i = 0; i < 3000; i++) {
+        cr_assert(ecs_has(world, with_health[i], ecs_id(Jump)));
+        Position *p = ecs_get(world, with_health[i], ecs_id(Position));
+        cr_assert_eq(p->x, i);
+        cr_assert_eq(p->y, -i);
+    }
+    for (int i = 0; i < 100; i++) {
+        cr_assert_not(ecs_has(world, without_health[i], ecs_id(Jump)));
+    }
+
+    ecs_bulk_remove(world, &health_query, ecs_id(Jump));
+
+    for (int i = 0; i < 3000; i++) {
+        cr_assert_not(ecs_has(world, with_health[i], ecs_id(Jump)));
+        cr_assert(ecs_has(world, with_health[i], ecs_id(Health)));
+        Position *p = ecs_get(world, with_health[i], ecs_id(Position));
+        cr_assert_eq(p->x, i);
+    }
+    ecs_fini(world);
+}
+
+Test(query, signature_matches_long_types) {
+    ecs_world_t *world = ecs_init();
+    ecs_entity_t components[16];
+    ecs_entity_t entity = ecs_new(world);
+
+    for (int i = 0; i < 16; i++) {
+        components[i] = ecs_new(world);
+    }
+    for (int i = 0; i < 16; i += 2) {
+        ecs_add(world, entity, components[i]);
+    }
+    const ecs_type_info_t *type = ecs_world_get_entity_archetype(world, entity)->type;
+
+    for (int a = 0; a < 16; a++) {
+        for (int b = 0; b < 16; b++) {
+            ecs_query_t q = query({
+                .terms = {
+                    { .id = components[15 - a], .oper = EcsQueryOperEqual },
+                    { .id = components[b], .oper = EcsQueryOperEqual },
+                    { .id = components[1], .oper = EcsQueryOperNot },
+                },
+            });
+            bool expected = (15 - a) % 2 == 0 && b % 2 == 0;
+            cr_assert_eq(ecs_query_match_type(&q, type), expected);
+        }
+    }
+
+    ecs_query_t excluded = query({
+        .terms = {
+            { .id = components[0], .oper = EcsQueryOperEqual },
+            { .id = components[14], .oper = EcsQueryOperNot },
+        },
+    });
+    cr_assert_not(ecs_query_match_type(&excluded, type));
+    ecs_fini(world);
+}
+
+Test(query, fields_use_precomputed_columns) {
+    ecs_world_t *world = bootstrap();
+    ecs_query_t q = query({
+        .terms = {
+            { .id = ecs_id(Health), .oper = EcsQueryOperEqual },
+            { .id = ecs_id(Position), .oper = EcsQueryOperEqual },
+            { .id = ecs_id(Jump), .oper = EcsQueryOperNot },
+        },
+    });
+    EcsQueryId query_id = ecs_query_register(world, &q);
+
+    for (int i = 0; i < 3000; i++) {
+        ecs_entity_t entity = ecs_new(world);
+        ecs_insert(world, entity, ecs_id(Position), &(Position) {i, -i});
+        ecs_add(world, entity, ecs_id(Health));
+        ecs_add(world, entity, ecs_id(EcsName));
+    }
+
+    int seen = 0;
+    ecs_iter_t it = ecs_query_iter(world, query_id);
+    while (ecs_iter_next(&it)) {
+        Position *p = ecs_field_at(&it, Position, 1);
+        cr_assert_eq(p, ecs_field(&it, Position));
+        cr_assert_eq(ecs_field_at(&it, Health, 0), ecs_field(&it, Health));
+        cr_assert_null(ecs_field_at(&it, Jump, 2));
+        cr_assert_not_null(ecs_field(&it, EcsName));
+        for (int i = 0; i < it.count; i++) {
+            cr_assert_eq(p[i].x, it.offset + i);
+        }
+        seen += it.count;
+    }
+    cr_assert_eq(seen, 3000);
+    ecs_fini(world);
+}
+
+static int count_visited_tables(ecs_world_t *world, EcsQueryId query_id) {
+    int tables = 0;
+    ecs_iter_t it = ecs_query_iter(world, query_id);
+
+    while (ecs_iter_next(&it)) {
+        cr_assert(it.count > 0);
+        tables++;
+    }
+    return tables;
+}
+
+Test(query, iteration_skips_empty_tables) {
+    ecs_world_t *world = bootstrap();
+    ecs_query_t q = query({
+        .terms = {
+            { .id = ecs_id(Position), .oper = EcsQueryOperEqual },
+        },
+    });
+    EcsQueryId query_id = ecs_query_register(world, &q);
+    ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, query_id);
+
+    ecs_entity_t a = ecs_new(world);
+    ecs_entity_t b = ecs_new(world);
+    ecs_add(world, a, ecs_id(Position));
+    ecs_add(world, b, ecs_id(Position));
+    ecs_add(world, a, ecs_id(Health));
+    ecs_add(world, a, ecs_id(Jump));
+    cr_assert_eq(cache->archetypes.count, 3);
+    cr_assert_eq(cache->active_count, 2);
+    cr_assert_eq(count_visited_tables(world, query_id), 2);
+
+    ecs_add(world, b, ecs_id(Health));
+    cr_assert_eq(cache->active_count, 2);
+
+    ecs_remove(world, a, ecs_id(Jump));
+    cr_assert_eq(cache->active_count, 1);
+    cr_assert_eq(count_visited_tables(world, query_id), 1);
+    ecs_kill(world, a);
+    ecs_kill(world, b);
+    cr_assert_eq(cache->active_count, 0);
+    cr_assert_eq(count_visited_tables(world, query_id), 0);
+    ecs_fini(world);
+}
+
+Test(query, from_str_keeps_access_modes) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Velocity);
+    ECS_REGISTER_COMPONENT(world, Health);
+    ECS_REGISTER_COMPONENT(world, Jump);
+
+    ecs_query_t *query = ecs_query_from_str(world, "[in] Position, [out] Velocity, [inout] Health, !Jump");
+    cr_assert_not_null(query);
+    cr_assert_eq(query->terms[0].access, EcsQueryAccessIn);
+    cr_assert_eq(query->terms[1].access, EcsQueryAccessOut);
+    cr_assert_eq(query->terms[2].access, EcsQueryAccessInOut);
+    cr_assert_eq(query->terms[3].access, EcsQueryAccessDefault);
+    free(query);
+    ecs_fini(world);
+}
+
+static atomic_int parallel_rows = 0;
+
+static void parallel_integrate(ecs_iter_t *it) {
+    Position *p = ecs_field(it, Position);
+    Velocity *v = ecs_field(it, Velocity);
+
+    for (int i = 0; i < it->count; i++) {
+        p[i].x += v[i].x;
+        if (ecs_it_entity(it, i).index % 10 == 0) {
+            ecs_add(it->world, ecs_it_entity(it, i), ecs_id(Health));
+        }
+    }
+    atomic_fetch_add(&parallel_rows, it->count);
+}
+
+Test(query, iter_parallel_visits_every_row_once) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Velocity);
+    ECS_REGISTER_COMPONENT(world, Health);
+    ECS_REGISTER_COMPONENT(world, Jump);
+    ecs_set_threads(world, 3);
+
+    ecs_entity_t entities[20000];
+    for (int i = 0; i < 20000; i++) {
+        entities[i] = ecs_new(world);
+        ecs_insert(world, entities[i], ecs_id(Position), &(Position) {i, 0});
+        ecs_insert(world, entities[i], ecs_id(Velocity), &(Velocity) {i % 7, 0});
+        if (i % 3 == 0) {
+            ecs_add(world, entities[i], ecs_id(Jump));
+        }
+    }
+    ecs_query_t query = query({
+        .terms = {
+            { .id = ecs_id(Velocity), .oper = EcsQueryOperEqual },
+            { .id = ecs_id(Position), .oper = EcsQueryOperEqual }
+        },
+    });
+    EcsQueryId query_id = ecs_query_register(world, &query);
+
+    ecs_iter_parallel(world, query_id, parallel_integrate, 100);
+
+    cr_assert_eq(atomic_load(&parallel_rows), 20000);
+    for (int i = 0; i < 20000; i++) {
+        cr_assert_eq(((Position *) ecs_get(world, entities[i], ecs_id(Position)))->x, i + i % 7);
+        cr_assert_eq(ecs_has(world, entities[i], ecs_id(Health)), entities[i].index % 10 == 0);
+    }
+    ecs_fini(world);
+}
+
+static atomic_int parallel_tagged = 0;
+
+static void parallel_count_tagged(ecs_iter_t *it) {
+    atomic_fetch_add(&parallel_tagged, it->count);
+}
+
+Test(query, iter_parallel_runs_on_tag_only_tables) {
+    ecs_world_t *world = bootstrap();
+    ecs_set_threads(world, 3);
+
+    for (int i = 0; i < 300; i++) {
+        ecs_entity_t entity = ecs_new(world);
+        ecs_add(world, entity, ecs_id(Jump));
+        if (i % 2) {
+            ecs_insert(world, entity, ecs_id(Position), &(Position) {i, 0});
+        }
+    }
+    EcsQueryId query_id = ecs_query_register(world, &query({ .terms = { { .id = ecs_id(Jump) } } }));
+
+    ecs_iter_parallel(world, query_id, parallel_count_tagged, 16);
+    cr_assert_eq(atomic_load(&parallel_tagged), 300);
+    ecs_fini(world);
+}
+
+Test(query, wildcard_pair_reports_matched_target) {
+    ecs_world_t *world = bootstrap();
+    ecs_entity_t parents[3] = { ecs_new(world), ecs_new(world), ecs_new(world) };
+    ecs_entity_t orphan = ecs_new(world);
+    ecs_add(world, orphan, ecs_id(Position));
+
+    uint32_t archetype_count = world->archetypes.count;
+    for (int i = 0; i < 3; i++) {
+        ecs_entity_t child = ecs_new(world);
+        ecs_add(world, child, ecs_id(Position));
+        ecs_add_pair(world, child, ecs_id(EcsChildOf), parents[i]);
+    }
+    // one table per parent, no hidden (ChildOf, *) column
+    cr_assert_eq(world->archetypes.count, archetype_count + 3);
+
+    ecs_query_t children_query = query({
+        .terms = {
+            { .id = ecs_id(Position), .oper = EcsQueryOperEqual },
+            { .id = ecs_make_pair(ecs_id(EcsChildOf), ecs_id(EcsWildcard)), .oper = EcsQueryOperEqual },
+        },
+    });
+    EcsQueryId query_id = ecs_query_register(world, &children_query);
+    uint32_t seen = 0;
+
+    ecs_iter_t it = ecs_query_iter(world, query_id);
+    while (ecs_iter_next(&it)) {
+        ecs_entity_t target = ecs_pair_target(ecs_field_id(&it, 1));
+
+        cr_assert_eq(it.count, 1);
+        for (int i = 0; i < 3; i++) {
+            if (target.index == parents[i].index) {
+                seen |= 1 << i;
+            }
+        }
+    }
+    cr_assert_eq(seen, 0b111);
+    cr_assert(ecs_has(world, orphan, ecs_id(Position)));
+    cr_assert_not(ecs_has_pair(world, orphan, ecs_id(EcsChildOf), ecs_id(EcsWildcard)));
+    ecs_fini(world);
+}
+
+static uint32_t hierarchy_depth(ecs_world_t *world, ecs_entity_t entity) {
+    uint32_t depth = 0;
+    ecs_entity_t pair;
+
+    while ((pair = ecs_type_info_find_relation(ecs_world_get_entity_archetype(world, entity)->type,
+                ecs_id(EcsChildOf).index)).value) {
+        entity = ecs_pair_target(pair);
+        depth++;
+    }
+    return depth;
+}
+
+static void assert_cascade_order(ecs_world_t *world, EcsQueryId query_id, uint32_t expected_rows) {
+    uint32_t last_depth = 0;
+    uint32_t rows = 0;
+
+    ecs_iter_t it = ecs_query_iter(world, query_id);
+    while (ecs_iter_next(&it)) {
+        for (int i = 0; i < it.count; i++) {
+            uint32_t depth = hierarchy_depth(world, ecs_it_entity(&it, i));
+            cr_assert(depth >= last_depth);
+            last_depth = depth;
+            rows++;
+        }
+    }
+    cr_assert_eq(rows, expected_rows);
+}
+
+Test(query, cascade_visits_parents_before_children) {
+    ecs_world_t *world = bootstrap();
+    ecs_entity_t root = ecs_new(world);
+    ecs_entity_t mid = ecs_new(world);
+    ecs_entity_t leaf = ecs_new(world);
+    ecs_entity_t other_root = ecs_new(world);
+
+    // tables are created leaf first
+    ecs_add(world, leaf, ecs_id(Position));
+    ecs_add_pair(world, leaf, ecs_id(EcsChildOf), mid);
+    ecs_add(world, mid, ecs_id(Position));
+    ecs_add_pair(world, mid, ecs_id(EcsChildOf), root);
+    ecs_add(world, root, ecs_id(Position));
+    ecs_add(world, other_root, ecs_id(Position));
+
+    EcsQueryId query_id = ecs_query_register(world, ecs_query_from_str(world, "Position, cascade(ChildOf)"));
+    ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, query_id);
+    cr_assert(cache->cascade);
+    assert_cascade_order(world, query_id, 4);
+
+    // the whole chain now hangs below other_root
+    ecs_add_pair(world, root, ecs_id(EcsChildOf), other_root);
+    cr_assert_eq(hierarchy_depth(world, leaf), 3);
+    assert_cascade_order(world, query_id, 4);
+
+    // pairs of other relations leave the depth order alone
+    uint32_t version = cache->cascade_version;
+    ecs_entity_t likes = ecs_new(world);
+    ecs_add_pair(world, mid, likes, leaf);
+    ecs_remove(world, mid, ecs_make_pair(likes, leaf));
+    cr_assert_eq(*(uint32_t *) ecs_sparseset_get(&world->cascade_versions, ecs_id(EcsChildOf).index), version);
+    assert_cascade_order(world, query_id, 4);
+    ecs_fini(world);
+}
+
+Test(query, sparse_components_toggle_without_moving) {
+    ecs_world_t *world = bootstrap();
+    ecs_entity_t entities[4];
+
+    ecs_set_component_sparse(world, ecs_id(Health));
+    ecs_set_component_sparse(world, ecs_id(Jump));
+    for (int i = 0; i < 4; i++) {
+        entities[i] = ecs_new(world);
+        ecs_insert(world, entities[i], ecs_id(Position), &(Position) { i, i });
+    }
+    ecs_archetype_id_t table = ecs_world_get_record(world, entities[0])->archetype_id;
+
+    ecs_insert(world, entities[0], ecs_id(Health), &(Health) { 10 });
+    ecs_insert(world, entities[2], ecs_id(Health), &(Health) { 30 });
+    ecs_add(world, entities[1], ecs_id(Jump));
+    ecs_add(world, entities[2], ecs_id(Jump));
+    for (int i = 0; i < 4; i++) {
+        cr_assert_eq(ecs_world_get_record(world, entities[i])->archetype_id, table);
+    }
+    cr_assert_eq(((Health *) ecs_get(world, entities[2], ecs_id(Health)))->value, 30);
+    cr_assert_not(ecs_has(world, entities[1], ecs_id(Health)));
+
+    // a sparse value cannot be strided over, so every row comes alone
+    int rows = 0, total = 0;
+    ecs_iter_t it = ecs_query_iter(world, ecs_query_register(world, ecs_query_from_str(world, "Position, Health")));
+    while (ecs_iter_next(&it)) {
+        cr_assert_eq(it.count, 1);
+        cr_assert_eq(ecs_field(&it, Position)->x * 10 + 10, ecs_field(&it, Health)->value);
+        total += ecs_field(&it, Health)->value;
+        rows++;
+    }
+    cr_assert_eq(rows, 2);
+    cr_assert_eq(total, 40);
+
+    // tags keep runs of adjacent rows together
+    it = ecs_query_iter(world, ecs_query_register(world, ecs_query_from_str(world, "Position, Jump, !Health")));
+    cr_assert(ecs_iter_next(&it));
+    cr_assert_eq(it.count, 1);
+    cr_assert_eq(ecs_it_entity(&it, 0).value, entities[1].value);
+    cr_assert_not(ecs_iter_next(&it));
+    ecs_remove(world, entities[2], ecs_id(Health));
+    it = ecs_query_iter(world, ecs_query_register(world, ecs_query_from_str(world, "Position, Jump")));
+    cr_assert(ecs_iter_next(&it));
+    cr_assert_eq(it.count, 2);
+    cr_assert_not(ecs_iter_next(&it));
+
+    // a recycled index starts without the values of the dead entity
+    ecs_kill(world, entities[0]);
+    ecs_entity_t recycled = ecs_new(world);
+    cr_assert_eq(recycled.index, entities[0].index);
+    cr_assert_not(ecs_has(world, recycled, ecs_id(Health)));
+    ecs_fini(world);
+}
+
+static int count_tables(ecs_world_t *world, EcsQueryId query_id, uint32_t *cursor) {
+    int tables = 0;
+    ecs_iter_t it = ecs_query_iter_since(world, query_id, cursor);
+
+    while (ecs_iter_next(&it)) {
+        tables++;
+    }
+    return tables;
+}
+
+Test(query, manual_changed_iteration_reports_each_write_once) {
+    ecs_world_t *world = bootstrap();
+    ecs_entity_t entity = ecs_new(world);
+    ecs_insert(world, entity, ecs_id(Position), &(Position) {1, 1});
+
+    EcsQueryId query_id = ecs_query_register(world, ecs_query_from_str(world, "Changed(Position)"));
+    ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, query_id);
+    uint32_t cursor = 0;
+    cr_assert_eq(count_tables(world, query_id, &cursor), 1);
+    cr_assert_eq(count_tables(world, query_id, &cursor), 0);
+
+    ecs_set(world, entity, ecs_id(Position), &(Position) {2, 2});
+    cr_assert_eq(count_tables(world, query_id, &cursor), 1);
+    cr_assert_eq(count_tables(world, query_id, &cursor), 0);
+
+    // plain iteration moves neither the world tick nor the systems' window
+    uint32_t tick = world->change_tick;
+    ecs_iter_t it = ecs_query_iter(world, query_id);
+    while (ecs_iter_next(&it)) {}
+    cr_assert_eq(world->change_tick, tick);
+    cr_assert_eq(cache->last_run, 0);
+    ecs_fini(world);
+}
@@ -5,6 +5,7 @@
 #include <criterion/criterion.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 static int medium_count = 0;
 
@@ -138,3 +139,268 @@ Test(system, relation) {
     cr_assert_eq(pos->x, 1);
     cr_assert_eq(pos->y, 1);
 }
+
+void GrantVelocitySys(ecs_iter_t *it) {
+    for (int i = 0; i < it->count; i++) {
+        ecs_set(it->world, ecs_it_entity(it, i), ecs_id(Velocity), &(Velocity) {2, 2});
+    }
+}
+
+Test(system, structural_changes_are_merged_after_the_phase) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Velocity);
+
+    ecs_entity_t players[100];
+    for (int i = 0; i < 100; i++) {
+        players[i] = ecs_new(world);
+        ecs_insert(world, players[i], ecs_id(Position), &(Position) {0, 0});
+    }
+
+    ECS_SYSTEM(world, GrantVelocitySys, EcsOnUpdate, Position, !Velocity);
+    ECS_SYSTEM(world, PosVelSys, EcsOnUpdate, Position, Velocity);
+
+    ecs_progress(world);
+    for (int i = 0; i < 100; i++) {
+        cr_assert_eq(((Velocity *) ecs_get(world, players[i], ecs_id(Velocity)))->x, 2);
+        cr_assert_eq(((Position *) ecs_get(world, players[i], ecs_id(Position)))->x, 0);
+    }
+
+    ecs_progress(world);
+    for (int i = 0; i < 100; i++) {
+        cr_assert_eq(((Position *) ecs_get(world, players[i], ecs_id(Position)))->x, 2);
+    }
+    ecs_fini(world);
+}
+
+void IntegrateSys(ecs_iter_t *it) {
+    Position *p = ecs_field(it, Position);
+    Velocity *v = ecs_field(it, Velocity);
+
+    for (int i = 0; i < it->count; i++) {
+        p[i].x += v[i].x;
+    }
+}
+
+void ReadPositionSys(ecs_iter_t *it) {
+    Position *p = ecs_field(it, Position);
+    Health *h = ecs_field(it, Health);
+
+    for (int i = 0; i < it->count; i++) {
+        h[i].value = p[i].x;
+    }
+}
+
+void AccelerateSys(ecs_iter_t *it) {
+    Velocity *v = ecs_field(it, Velocity);
+
+    for (int i = 0; i < it->count; i++) {
+        v[i].x++;
+        if (v[i].x == 3) {
+            ecs_add(it->world, ecs_it_entity(it, i), ecs_id(Jump));
+        }
+    }
+}
+
+Test(system, threaded_phase_keeps_declaration_order_between_conflicts) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Velocity);
+    ECS_REGISTER_COMPONENT(world, Health);
+    ECS_REGISTER_COMPONENT(world, Jump);
+    ecs_set_threads(world, 4);
+
+    ecs_entity_t entities[1000];
+    for (int i = 0; i < 1000; i++) {
+        entities[i] = ecs_new(world);
+        ecs_insert(world, entities[i], ecs_id(Position), &(Position) {i, 0});
+        ecs_insert(world, entities[i], ecs_id(Velocity), &(Velocity) {1, 0});
+        ecs_insert(world, entities[i], ecs_id(Health), &(Health) {0});
+    }
+
+    ECS_SYSTEM(world, IntegrateSys, EcsOnUpdate, [inout] Position, [in] Velocity);
+    ECS_SYSTEM(world, ReadPositionSys, EcsOnUpdate, [in] Position, [out] Health);
+    ECS_SYSTEM(world, AccelerateSys, EcsOnUpdate, [inout] Velocity);
+
+    for (int frame = 0; frame < 3; frame++) {
+        ecs_progress(world);
+    }
+    for (int i = 0; i < 1000; i++) {
+        cr_assert_eq(((Position *) ecs_get(world, entities[i], ecs_id(Position)))->x, i + 6);
+        cr_assert_eq(((Health *) ecs_get(world, entities[i], ecs_id(Health)))->value, i + 6);
+        cr_assert_eq(((Velocity *) ecs_get(world, entities[i], ecs_id(Velocity)))->x, 4);
+        cr_assert(ecs_has(world, entities[i], ecs_id(Jump)));
+    }
+    ecs_fini(world);
+}
+
+static char pipeline_trace[8];
+static int pipeline_trace_len = 0;
+
+static void TraceLate(ecs_iter_t *it) { (void) it; pipeline_trace[pipeline_trace_len++] = 'L'; }
+static void TraceUpdate(ecs_iter_t *it) { (void) it; pipeline_trace[pipeline_trace_len++] = 'U'; }
+static void TracePhysics(ecs_iter_t *it) { (void) it; pipeline_trace[pipeline_trace_len++] = 'P'; }
+static void TraceInput(ecs_iter_t *it) { (void) it; pipeline_trace[pipeline_trace_len++] = 'I'; }
+
+Test(system, pipeline_orders_custom_phases) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ecs_singleton(world, ecs_id(Position));
+
+    ecs_entity_t late = ecs_phase(world, ecs_id(EcsOnPostUpdate));
+    ecs_entity_t physics = ecs_phase(world, ecs_id(EcsOnUpdate));
+    ecs_add_pair(world, physics, ecs_id(EcsEnables), late);
+    ecs_entity_t input = ecs_phase(world, ECS_NULL);
+    ecs_add_pair(world, input, ecs_id(EcsEnables), ecs_id(EcsOnPreUpdate));
+
+    ecs_query_t *query = ecs_query_from_str(world, "Position");
+    ecs_system(world, TraceLate, late, query);
+    ecs_system(world, TracePhysics, physics, query);
+    ecs_system(world, TraceUpdate, ecs_id(EcsOnUpdate), query);
+    ecs_system(world, TraceInput, input, query);
+    free(query);
+
+    ecs_progress(world);
+    cr_assert_eq(pipeline_trace_len, 4);
+    cr_assert_eq(memcmp(pipeline_trace, "IUPL", 4), 0);
+    cr_assert_not(world->pipeline.dirty);
+    cr_assert_eq(world->pipeline.phase_ends.count, 6);
+
+    ecs_entity_t late_system = ecs_new(world);
+    ecs_add_pair(world, late_system, ecs_id(EcsPhase), late);
+    cr_assert(world->pipeline.dirty);
+    ecs_fini(world);
+}
+
+Test(system, recycled_system_index_keeps_declaration_order) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ecs_singleton(world, ecs_id(Position));
+
+    ecs_entity_t scratch = ecs_new(world);
+    ecs_query_t *query = ecs_query_from_str(world, "Position");
+    ecs_entity_t first = ecs_system(world, TraceUpdate, ecs_id(EcsOnUpdate), query);
+    ecs_kill(world, scratch);
+    ecs_entity_t second = ecs_system(world, TraceLate, ecs_id(EcsOnUpdate), query);
+    free(query);
+    cr_assert(second.index < first.index);
+
+    pipeline_trace_len = 0;
+    ecs_progress(world);
+    cr_assert_eq(pipeline_trace_len, 2);
+    cr_assert_eq(memcmp(pipeline_trace, "UL", 2), 0);
+    ecs_fini(world);
+}
+
+Test(system, recycled_phase_index_keeps_creation_order) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ecs_singleton(world, ecs_id(Position));
+
+    ecs_entity_t scratch = ecs_new(world);
+    ecs_entity_t first = ecs_phase(world, ECS_NULL);
+    ecs_kill(world, scratch);
+    ecs_entity_t second = ecs_phase(world, ECS_NULL);
+    cr_assert(second.index < first.index);
+
+    ecs_query_t *query = ecs_query_from_str(world, "Position");
+    ecs_system(world, TraceLate, second, query);
+    ecs_system(world, TraceUpdate, first, query);
+    free(query);
+
+    pipeline_trace_len = 0;
+    ecs_progress(world);
+    cr_assert_eq(pipeline_trace_len, 2);
+    cr_assert_eq(memcmp(pipeline_trace, "UL", 2), 0);
+    ecs_fini(world);
+}
+
+static int changed_tables = 0;
+
+void MoveRightSys(ecs_iter_t *it) {
+    Position *p = ecs_field(it, Position);
+
+    for (int i = 0; i < it->count; i++) {
+        p[i].x++;
+    }
+}
+
+void SyncChangedSys(ecs_iter_t *it) {
+    (void) it;
+    changed_tables++;
+}
+
+Test(system, changed_skips_tables_not_written_since_last_run) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Velocity);
+    ECS_REGISTER_COMPONENT(world, Health);
+
+    ecs_entity_t still = ecs_new(world);
+    ecs_insert(world, still, ecs_id(Position), &(Position) {0, 0});
+    ecs_entity_t moving = ecs_new(world);
+    ecs_insert(world, moving, ecs_id(Position), &(Position) {0, 0});
+    ecs_add(world, moving, ecs_id(Velocity));
+    ecs_entity_t hurt = ecs_new(world);
+    ecs_insert(world, hurt, ecs_id(Position), &(Position) {0, 0});
+    ecs_add(world, hurt, ecs_id(Health));
+
+    ECS_SYSTEM(world, MoveRightSys, EcsOnUpdate, [inout] Position, [in] Velocity);
+    ECS_SYSTEM(world, SyncChangedSys, EcsOnPostUpdate, [in] Changed(Position));
+
+    changed_tables = 0;
+    ecs_progress(world);
+    cr_assert_eq(changed_tables, 3);
+
+    changed_tables = 0;
+    ecs_progress(world);
+    cr_assert_eq(changed_tables, 1);
+
+    ecs_set(world, hurt, ecs_id(Position), &(Position) {5, 5});
+    changed_tables = 0;
+    ecs_progress(world);
+    cr_assert_eq(changed_tables, 2);
+    cr_assert_eq(((Position *) ecs_get(world, moving, ecs_id(Position)))->x, 3);
+    ecs_fini(world);
+}
+
+static EcsQueryId parallel_move_query;
+static bool parallel_moves = false;
+
+void ParallelMoveSys(ecs_iter_t *it) {
+    if (parallel_moves) {
+        ecs_iter_parallel(it->world, parallel_move_query, MoveRightSys, 0);
+    }
+}
+
+Test(system, iter_parallel_in_a_system_stamps_the_system_tick) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Velocity);
+    ECS_REGISTER_COMPONENT(world, Health);
+
+    ecs_entity_t moving = ecs_new(world);
+    ecs_insert(world, moving, ecs_id(Position), &(Position) {0, 0});
+    ecs_add(world, moving, ecs_id(Velocity));
+    ecs_entity_t hurt = ecs_new(world);
+    ecs_insert(world, hurt, ecs_id(Position), &(Position) {0, 0});
+    ecs_add(world, hurt, ecs_id(Health));
+
+    parallel_move_query = ecs_query_register(world, ecs_query_from_str(world, "[inout] Position, [in] Health"));
+    ECS_SYSTEM(world, ParallelMoveSys, EcsOnUpdate, [inout] Position, [in] Velocity);
+    ECS_SYSTEM(world, SyncChangedSys, EcsOnUpdate, [in] Changed(Position));
+
+    parallel_moves = true;
+    changed_tables = 0;
+    ecs_progress(world);
+    cr_assert_eq(changed_tables, 2);
+    cr_assert_eq(((Position *) ecs_get(world, hurt, ecs_id(Position)))->x, 1);
+
+    // the nested write belongs to the previous frame now
+    parallel_moves = false;
+    changed_tables = 0;
+    ecs_progress(world);
+    cr_assert_eq(changed_tables, 1);
+    cr_assert_eq(world->defer_depth, 0);
+    ecs_fini(world);
+}
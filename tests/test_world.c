@@ -192,3 +192,476 @@ ecs_entity_t position;
 void remove_added_position(ecs_world_t *world, ecs_entity_t entity) {
     ecs_remove(world, entity, position);
 }
+
+Test(world, bulk_new_creates_entities_in_target_archetype) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Health);
+
+    ecs_type_t type = ECS_VEC_RAW(ecs_entity_t, ecs_id(Health), ecs_id(Position));
+    ecs_entity_t ids[5000];
+
+    ecs_bulk_new(world, &type, 5000, ids, NULL);
+
+    for (int i = 0; i < 5000; i++) {
+        cr_assert(ecs_is_alive(world, ids[i]));
+        cr_assert(ecs_has(world, ids[i], ecs_id(Position)));
+        cr_assert(ecs_has(world, ids[i], ecs_id(Health)));
+        Position *p = ecs_get(world, ids[i], ecs_id(Position));
+        cr_assert_eq(p->x, 0);
+    }
+
+    ecs_entity_t single = ecs_new(world);
+    ecs_add(world, single, ecs_id(Position));
+    ecs_add(world, single, ecs_id(Health));
+    cr_assert_eq(ecs_world_get_record(world, single)->archetype_id,
+                 ecs_world_get_record(world, ids[0])->archetype_id);
+    cr_assert_eq(ecs_world_get_record(world, single)->row, 5000);
+    ecs_fini(world);
+}
+
+Test(world, bulk_new_copies_initial_values) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Health);
+
+    Position positions[3000];
+    for (int i = 0; i < 3000; i++) {
+        positions[i] = (Position) {i, i + 1};
+    }
+
+    ecs_type_t type = ECS_VEC_RAW(ecs_entity_t, ecs_id(Position), ecs_id(Health));
+    const void *values[] = { positions, NULL };
+    ecs_entity_t ids[3000];
+
+    ecs_new(world);
+    ecs_bulk_new(world, &type, 3000, ids, values);
+
+    for (int i = 0; i < 3000; i++) {
+        Position *p = ecs_get(world, ids[i], ecs_id(Position));
+        Health *h = ecs_get(world, ids[i], ecs_id(Health));
+        cr_assert_eq(p->x, i);
+        cr_assert_eq(p->y, i + 1);
+        cr_assert_eq(h->value, 0);
+    }
+    ecs_fini(world);
+}
+
+Test(world, bulk_new_keeps_sparse_components_out_of_the_table) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Health);
+    ecs_set_component_sparse(world, ecs_id(Health));
+
+    Position positions[3] = { {0, 0}, {1, 1}, {2, 2} };
+    Health healths[3] = { {10}, {20}, {30} };
+    ecs_type_t type = ECS_VEC_RAW(ecs_entity_t, ecs_id(Health), ecs_id(Position));
+    const void *values[] = { healths, positions };
+    ecs_entity_t ids[3];
+
+    ecs_bulk_new(world, &type, 3, ids, values);
+
+    ecs_archetype_t *archetype = ecs_world_get_entity_archetype(world, ids[0]);
+    cr_assert_eq(archetype->type->ids.count, 1);
+    cr_assert_eq(((Health *) ecs_get(world, ids[2], ecs_id(Health)))->value, 30);
+
+    int total = 0;
+    ecs_iter_t it = ecs_query_iter(world, ecs_query_register(world, ecs_query_from_str(world, "Position, Health")));
+    while (ecs_iter_next(&it)) {
+        cr_assert_eq(ecs_field(&it, Position)->x * 10 + 10, ecs_field(&it, Health)->value);
+        total += ecs_field(&it, Health)->value;
+    }
+    cr_assert_eq(total, 60);
+
+    ecs_remove(world, ids[1], ecs_id(Health));
+    cr_assert_not(ecs_has(world, ids[1], ecs_id(Health)));
+    cr_assert_eq(ecs_world_get_entity_archetype(world, ids[1]), archetype);
+    ecs_fini(world);
+}
+
+Test(world, has_pair_does_not_allocate_sparse_pages) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, MainScene);
+
+    ecs_entity_t player = ecs_new(world);
+    ecs_add(world, player, ecs_id(Position));
+
+    ecs_archetype_t *archetype = ecs_world_get_entity_archetype(world, player);
+    size_t pages = archetype->rows.pages.count;
+    uint32_t high_capacity = archetype->rows.high_keys.capacity;
+
+    cr_assert_not(ecs_has_pair(world, player, ecs_id(EcsChildOf), ecs_id(MainScene)));
+    cr_assert_not(ecs_has(world, player, (ecs_entity_t) { .value = UINT64_MAX >> 1 }));
+    cr_assert_eq(archetype->rows.pages.count, pages);
+    cr_assert_eq(archetype->rows.high_keys.capacity, high_capacity);
+    ecs_fini(world);
+}
+
+Test(world, sparseset_remove_keeps_remaining_keys) {
+    ecs_sparseset_t set;
+    ecs_sparseset_init(&set, sizeof(uint32_t));
+
+    for (uint32_t i = 1; i <= 600; i++) {
+        uint64_t key = i % 2 ? i : ((uint64_t) i << 40) | i;
+        ecs_sparseset_insert(&set, key, &i);
+    }
+    for (uint32_t i = 1; i <= 600; i += 3) {
+        uint64_t key = i % 2 ? i : ((uint64_t) i << 40) | i;
+        ecs_sparseset_remove(&set, key);
+    }
+    for (uint32_t i = 1; i <= 600; i++) {
+        uint64_t key = i % 2 ? i : ((uint64_t) i << 40) | i;
+        uint32_t *value = ecs_sparseset_get(&set, key);
+        if ((i - 1) % 3 == 0) {
+            cr_assert_null(value);
+        } else {
+            cr_assert_not_null(value);
+            cr_assert_eq(*value, i);
+        }
+    }
+    ecs_sparseset_fini(&set);
+}
+
+Test(world, archetype_map_grows_past_initial_capacity) {
+    ecs_world_t *world = ecs_init();
+    ecs_entity_t tag = ecs_new(world);
+    ecs_entity_t entities[9000];
+
+    cr_assert(world->archetype_map.capacity <= 64);
+    for (int i = 0; i < 9000; i++) {
+        entities[i] = ecs_new(world);
+        ecs_add(world, entities[i], tag);
+        ecs_add(world, entities[i], ecs_new(world));
+    }
+    cr_assert(world->archetype_map.capacity > 8192);
+
+    for (int i = 0; i < 9000; i++) {
+        ecs_archetype_t *archetype = ecs_world_get_entity_archetype(world, entities[i]);
+        ecs_type_t type;
+        ecs_vec_copy(&archetype->type->ids, &type);
+        cr_assert_eq(ecs_archetype_get_or_create(world, &type),
+                     ecs_world_get_record(world, entities[i])->archetype_id);
+        ecs_vec_free(&type);
+    }
+
+    size_t archetype_count = world->archetypes.count;
+    ecs_remove(world, entities[42], tag);
+    ecs_add(world, entities[42], tag);
+    cr_assert_eq(world->archetypes.count, archetype_count + 1);
+    ecs_fini(world);
+}
+
+Test(world, gc_reclaims_empty_archetypes) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Health);
+    ecs_query_t q = query({ .terms = { { .id = ecs_id(Position), .oper = EcsQueryOperEqual } } });
+    EcsQueryId query_id = ecs_query_register(world, &q);
+    ecs_query_cache_t *cache = ECS_VEC_GET(ecs_query_cache_t, &world->queries, query_id);
+
+    ecs_entity_t entity = ecs_new(world);
+    ecs_insert(world, entity, ecs_id(Position), &(Position) {3, 4});
+    ecs_archetype_id_t transitional = ecs_world_get_record(world, entity)->archetype_id;
+    ecs_add(world, entity, ecs_id(Health));
+    cr_assert_eq(cache->archetypes.count, 2);
+
+    cr_assert_eq(ecs_world_gc(world, (ecs_gc_policy_t) { .empty_frames = 2 }), 0);
+    ecs_progress(world);
+    ecs_progress(world);
+    cr_assert(ecs_world_gc(world, (ecs_gc_policy_t) { .empty_frames = 2 }) > 0);
+
+    cr_assert_not(ecs_archetype_is_alive(ecs_world_get_archetype(world, transitional)));
+    cr_assert(ecs_archetype_is_alive(ecs_world_get_entity_archetype(world, entity)));
+    cr_assert_eq(cache->archetypes.count, 1);
+    cr_assert_null(ecs_smallmap_get(&ecs_world_get_default_archetype(world)->add_edge, ecs_id(Position).value));
+
+    ecs_remove(world, entity, ecs_id(Health));
+    cr_assert(ecs_archetype_is_alive(ecs_world_get_entity_archetype(world, entity)));
+    cr_assert_eq(ecs_world_get_record(world, entity)->archetype_id, transitional);
+    cr_assert_eq(((Position *) ecs_get(world, entity, ecs_id(Position)))->y, 4);
+    cr_assert_eq(cache->archetypes.count, 2);
+    cr_assert_eq(cache->active_count, 1);
+    ecs_fini(world);
+}
+
+static int kill_remove_hook_calls = 0;
+
+static void count_position_removes(ecs_iter_t *it) {
+    kill_remove_hook_calls += it->count;
+}
+
+Test(world, kill_patches_moved_row_and_fires_remove_hooks) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ecs_remove_hook(world, ecs_id(Position), count_position_removes);
+    kill_remove_hook_calls = 0;
+
+    ecs_entity_t entities[3];
+    for (int i = 0; i < 3; i++) {
+        entities[i] = ecs_new(world);
+        ecs_insert(world, entities[i], ecs_id(Position), &(Position) {i, i});
+    }
+    ecs_kill(world, entities[0]);
+    ecs_kill(world, entities[0]);
+
+    cr_assert_eq(kill_remove_hook_calls, 1);
+    cr_assert_not(ecs_is_alive(world, entities[0]));
+    cr_assert_eq(((Position *) ecs_get(world, entities[2], ecs_id(Position)))->x, 2);
+    cr_assert_eq(((Position *) ecs_get(world, entities[1], ecs_id(Position)))->x, 1);
+    cr_assert_eq(ecs_new(world).index, entities[0].index);
+    ecs_fini(world);
+}
+
+Test(world, delete_batch_compacts_tables) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Health);
+    ecs_remove_hook(world, ecs_id(Position), count_position_removes);
+    kill_remove_hook_calls = 0;
+
+    ecs_entity_t entities[3000];
+    ecs_entity_t doomed[1001];
+    uint32_t doomed_count = 0;
+    for (int i = 0; i < 3000; i++) {
+        entities[i] = ecs_new(world);
+        ecs_insert(world, entities[i], ecs_id(Position), &(Position) {i, -i});
+        if (i % 2) {
+            ecs_add(world, entities[i], ecs_id(Health));
+        }
+        if (i % 3 == 0) {
+            doomed[doomed_count++] = entities[i];
+        }
+    }
+    doomed[doomed_count++] = entities[0];
+
+    ecs_delete_batch(world, doomed, doomed_count);
+
+    cr_assert_eq(kill_remove_hook_calls, 1000);
+    for (int i = 0; i < 3000; i++) {
+        cr_assert_eq(ecs_is_alive(world, entities[i]), i % 3 != 0);
+        if (i % 3) {
+            ecs_entity_record_t *record = ecs_world_get_record(world, entities[i]);
+            ecs_archetype_t *archetype = ecs_world_get_archetype(world, record->archetype_id);
+            cr_assert_eq(ECS_VEC_GET(ecs_entity_t, &archetype->entities, record->row)->value, entities[i].value);
+            cr_assert_eq(((Position *) ecs_get(world, entities[i], ecs_id(Position)))->y, -i);
+        }
+    }
+    ecs_fini(world);
+}
+
+Test(world, delete_batch_waits_while_deferred) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ecs_entity_t entities[3];
+
+    for (int i = 0; i < 3; i++) {
+        entities[i] = ecs_new(world);
+        ecs_insert(world, entities[i], ecs_id(Position), &(Position) {i, i});
+    }
+    ecs_defer_begin(world);
+    ecs_delete_batch(world, entities, 2);
+    cr_assert(ecs_is_alive(world, entities[0]));
+    cr_assert_eq(ecs_world_get_entity_archetype(world, entities[2])->entities.count, 3);
+    ecs_defer_end(world);
+
+    cr_assert_not(ecs_is_alive(world, entities[0]));
+    cr_assert_not(ecs_is_alive(world, entities[1]));
+    cr_assert_eq(((Position *) ecs_get(world, entities[2], ecs_id(Position)))->x, 2);
+    ecs_fini(world);
+}
+
+Test(world, kill_deferred_runs_at_end_of_progress) {
+    ecs_world_t *world = ecs_init();
+    ecs_entity_t entity = ecs_new(world);
+
+    ecs_kill_deferred(world, entity);
+    ecs_kill_deferred(world, entity);
+    cr_assert(ecs_is_alive(world, entity));
+    ecs_progress(world);
+    cr_assert_not(ecs_is_alive(world, entity));
+    cr_assert_eq(world->kill_queue.count, 0);
+    ecs_fini(world);
+}
+
+Test(world, entity_records_are_stable_and_recycled) {
+    ecs_world_t *world = ecs_init();
+    ecs_entity_t first = ecs_new(world);
+    ecs_entity_record_t *record = ecs_world_get_record(world, first);
+    ecs_entity_t last = first;
+
+    for (int i = 0; i < 3 * ECS_ENTITY_PAGE_SIZE; i++) {
+        last = ecs_new(world);
+    }
+    cr_assert_eq(ecs_world_get_record(world, first), record);
+    cr_assert_eq(ecs_world_get_record(world, last)->row + 1, ecs_world_get_default_archetype(world)->entities.count);
+
+    ecs_kill(world, first);
+    ecs_kill(world, last);
+    ecs_entity_t reused = ecs_new(world);
+    cr_assert_eq(reused.index, last.index);
+    cr_assert_eq(reused.gen, last.gen + 1);
+    cr_assert_eq(ecs_new(world).index, first.index);
+    cr_assert(ecs_is_alive(world, reused));
+    cr_assert_not(ecs_is_alive(world, last));
+    cr_assert_not(ecs_is_alive(world, (ecs_entity_t) { .index = last.index, .gen = last.gen + 2 }));
+    ecs_fini(world);
+}
+
+static int defer_add_hook_calls = 0;
+
+static void count_position_adds(ecs_iter_t *it) {
+    defer_add_hook_calls += it->count;
+}
+
+Test(world, defer_coalesces_ops_into_one_move) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ECS_REGISTER_COMPONENT(world, Velocity);
+    ECS_REGISTER_COMPONENT(world, Health);
+    ecs_add_hook(world, ecs_id(Position), count_position_adds);
+    ecs_remove_hook(world, ecs_id(Health), count_position_removes);
+    defer_add_hook_calls = 0;
+    kill_remove_hook_calls = 0;
+
+    ecs_entity_t entity = ecs_new(world);
+    ecs_entity_t doomed = ecs_new(world);
+    ecs_archetype_id_t root = ecs_world_get_record(world, entity)->archetype_id;
+
+    ecs_defer_begin(world);
+    ecs_add(world, entity, ecs_id(Position));
+    ecs_add(world, entity, ecs_id(Health));
+    ecs_set(world, entity, ecs_id(Velocity), &(Velocity) {3, 4});
+    ecs_remove(world, entity, ecs_id(Health));
+    ecs_set(world, entity, ecs_id(Position), &(Position) {1, 2});
+    ecs_add(world, doomed, ecs_id(Position));
+    ecs_kill(world, doomed);
+    cr_assert_eq(ecs_world_get_record(world, entity)->archetype_id, root);
+    cr_assert(ecs_is_alive(world, doomed));
+    ecs_defer_end(world);
+
+    cr_assert_not(ecs_is_alive(world, doomed));
+    cr_assert_not(ecs_has(world, entity, ecs_id(Health)));
+    cr_assert_eq(((Position *) ecs_get(world, entity, ecs_id(Position)))->y, 2);
+    cr_assert_eq(((Velocity *) ecs_get(world, entity, ecs_id(Velocity)))->x, 3);
+    cr_assert_eq(defer_add_hook_calls, 1);
+    cr_assert_eq(kill_remove_hook_calls, 0);
+    cr_assert_eq(world->commands.commands.count, 0);
+    ecs_fini(world);
+}
+
+static int position_hook_batches = 0;
+static float position_hook_sum = 0;
+
+static void sum_positions(ecs_iter_t *it) {
+    Position *p = ecs_field(it, Position);
+
+    position_hook_batches++;
+    for (int i = 0; i < it->count; i++) {
+        cr_assert_eq(p[i].x, ((Position *) ecs_get(it->world, ecs_it_entity(it, i), ecs_id(Position)))->x);
+        position_hook_sum += p[i].x;
+    }
+}
+
+Test(world, hooks_receive_row_ranges) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ecs_set_hook(world, ecs_id(Position), sum_positions);
+    ecs_remove_hook(world, ecs_id(Position), sum_positions);
+
+    Position positions[3000];
+    for (int i = 0; i < 3000; i++) {
+        positions[i] = (Position) {i, 0};
+    }
+    ecs_type_t type = ECS_VEC_RAW(ecs_entity_t, ecs_id(Position));
+    const void *values[] = { positions };
+    ecs_entity_t ids[3000];
+
+    ecs_bulk_new(world, &type, 3000, ids, values);
+    cr_assert_eq(position_hook_sum, 2999 * 3000 / 2);
+    cr_assert_eq(position_hook_batches, ecs_archetype_chunk_count(ecs_world_get_entity_archetype(world, ids[0])));
+
+    // remove hooks still see the value being removed
+    position_hook_sum = 0;
+    ecs_remove(world, ids[7], ecs_id(Position));
+    cr_assert_eq(position_hook_sum, 7);
+    cr_assert_not(ecs_has(world, ids[7], ecs_id(Position)));
+    ecs_fini(world);
+}
+
+Test(world, set_adds_a_missing_component_before_its_hook) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ecs_set_hook(world, ecs_id(Position), sum_positions);
+    position_hook_sum = 0;
+    position_hook_batches = 0;
+
+    ecs_entity_t entity = ecs_new(world);
+    ecs_set(world, entity, ecs_id(Position), &(Position) {5, 6});
+
+    cr_assert(ecs_has(world, entity, ecs_id(Position)));
+    cr_assert_eq(((Position *) ecs_get(world, entity, ecs_id(Position)))->y, 6);
+    cr_assert_eq(position_hook_batches, 1);
+    cr_assert_eq(position_hook_sum, 5);
+    ecs_fini(world);
+}
+
+Test(world, pairs_hold_full_target_index) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ecs_entity_t likes = ecs_new(world);
+    ecs_entity_t target = ecs_new(world);
+
+    while (target.index < 70000) {
+        target = ecs_new(world);
+    }
+    ecs_entity_t alias = { .index = target.index & 0xFFFF };
+    ecs_entity_t fan = ecs_new(world);
+    ecs_add_pair(world, fan, likes, target);
+
+    cr_assert(ecs_has_pair(world, fan, likes, target));
+    cr_assert_not(ecs_has_pair(world, fan, likes, alias));
+    cr_assert_eq(ecs_pair_target(ecs_make_pair(likes, target)).index, target.index);
+    cr_assert_eq(ecs_pair_relation(ecs_make_pair(likes, target)).index, likes.index);
+    cr_assert_not(ecs_is_pair(target));
+    ecs_fini(world);
+}
+
+Test(world, killing_a_target_cleans_up_its_pairs) {
+    ecs_world_t *world = ecs_init();
+    ECS_REGISTER_COMPONENT(world, Position);
+    ecs_entity_t likes = ecs_new(world);
+    ecs_entity_t parent = ecs_new(world);
+    ecs_entity_t other = ecs_new(world);
+    ecs_entity_t children[3];
+    ecs_entity_t grandchild = ecs_new(world);
+    ecs_entity_t fan = ecs_new(world);
+
+    for (int i = 0; i < 3; i++) {
+        children[i] = ecs_new(world);
+        ecs_add_pair(world, children[i], ecs_id(EcsChildOf), parent);
+    }
+    ecs_add(world, children[2], ecs_id(Position));
+    ecs_add_pair(world, grandchild, ecs_id(EcsChildOf), children[0]);
+    ecs_add_pair(world, fan, likes, parent);
+    ecs_add_pair(world, fan, likes, other);
+    ecs_add(world, fan, ecs_id(Position));
+
+    const ecs_vec_t *tables = ecs_pair_archetypes(world, ecs_id(EcsChildOf), parent);
+    cr_assert(tables->count >= 2);
+
+    ecs_kill(world, parent);
+    for (int i = 0; i < 3; i++) {
+        cr_assert_not(ecs_is_alive(world, children[i]));
+    }
+    cr_assert_not(ecs_is_alive(world, grandchild));
+    cr_assert(ecs_is_alive(world, fan));
+    cr_assert_not(ecs_has_pair(world, fan, likes, parent));
+    cr_assert(ecs_has_pair(world, fan, likes, other));
+    cr_assert(ecs_has_pair(world, fan, likes, ecs_id(EcsWildcard)));
+    cr_assert(ecs_has(world, fan, ecs_id(Position)));
+
+    ecs_kill(world, other);
+    cr_assert_not(ecs_has_pair(world, fan, likes, ecs_id(EcsWildcard)));
+    ecs_fini(world);
+}